@@ -0,0 +1,146 @@
+#include "Angel.h"
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#elif !defined(__APPLE__)
+extern "C" GLExtraProc glXGetProcAddressARB( const GLubyte* );
+#endif
+
+#ifdef GLEXTRA_BUFFER_STORAGE
+PFNGLBUFFERSTORAGEPROC  glextBufferStorage = NULL;
+#endif
+
+#ifdef GLEXTRA_MULTI_DRAW_INDIRECT
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC  glextMultiDrawElementsIndirect = NULL;
+#endif
+
+#ifdef GLEXTRA_DEBUG
+PFNGLDEBUGMESSAGECALLBACKPROC  glextDebugMessageCallback = NULL;
+PFNGLDEBUGMESSAGECONTROLPROC   glextDebugMessageControl = NULL;
+#endif
+
+#ifdef GLEXTRA_PROGRAM_BINARY
+PFNGLGETPROGRAMBINARYPROC   glextGetProgramBinary = NULL;
+PFNGLPROGRAMBINARYPROC      glextProgramBinary = NULL;
+PFNGLPROGRAMPARAMETERIPROC  glextProgramParameteri = NULL;
+#endif
+
+// Look up an entry point through the window system
+static GLExtraProc
+defaultGetProcAddress( const char* name )
+{
+#ifdef _WIN32
+    return (GLExtraProc) wglGetProcAddress( name );
+#elif defined(__APPLE__)
+    return NULL;
+#else
+    return glXGetProcAddressARB( (const GLubyte*) name );
+#endif
+}
+
+void
+LoadGLExtra( GLExtraProc (*getProcAddress)( const char* ) )
+{
+    if ( getProcAddress == NULL ) { getProcAddress = defaultGetProcAddress; }
+
+#ifdef GLEXTRA_BUFFER_STORAGE
+    glextBufferStorage = (PFNGLBUFFERSTORAGEPROC) getProcAddress( "glBufferStorage" );
+#endif
+#ifdef GLEXTRA_MULTI_DRAW_INDIRECT
+    glextMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)
+	getProcAddress( "glMultiDrawElementsIndirect" );
+#endif
+#ifdef GLEXTRA_DEBUG
+    glextDebugMessageCallback = (PFNGLDEBUGMESSAGECALLBACKPROC)
+	getProcAddress( "glDebugMessageCallback" );
+    glextDebugMessageControl = (PFNGLDEBUGMESSAGECONTROLPROC)
+	getProcAddress( "glDebugMessageControl" );
+#endif
+#ifdef GLEXTRA_PROGRAM_BINARY
+    glextGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)
+	getProcAddress( "glGetProgramBinary" );
+    glextProgramBinary = (PFNGLPROGRAMBINARYPROC)
+	getProcAddress( "glProgramBinary" );
+    glextProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)
+	getProcAddress( "glProgramParameteri" );
+#endif
+}
+
+bool
+HasGLVersion( int major, int minor )
+{
+    GLint  actualMajor = 0, actualMinor = 0;
+    glGetIntegerv( GL_MAJOR_VERSION, &actualMajor );
+    glGetIntegerv( GL_MINOR_VERSION, &actualMinor );
+    glGetError();  // GL_MAJOR_VERSION is unknown before OpenGL 3.0
+
+    return actualMajor > major || (actualMajor == major && actualMinor >= minor);
+}
+
+bool
+HasGLExtension( const char* name )
+{
+    GLint  count = 0;
+    glGetIntegerv( GL_NUM_EXTENSIONS, &count );
+
+    for ( GLint i = 0; i < count; ++i ) {
+	const char* ext = (const char*) glGetStringi( GL_EXTENSIONS, i );
+	if ( ext != NULL && strcmp( ext, name ) == 0 ) { return true; }
+    }
+    return false;
+}
+
+static const char*
+DebugTypeString( GLenum type )
+{
+    switch( type ) {
+	case GL_DEBUG_TYPE_ERROR:               return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "undefined behaviour";
+	case GL_DEBUG_TYPE_PORTABILITY:         return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE:         return "performance";
+	default:                                return "other";
+    }
+}
+
+static const char*
+DebugSeverityString( GLenum severity )
+{
+    switch( severity ) {
+	case GL_DEBUG_SEVERITY_HIGH:   return "high";
+	case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+	case GL_DEBUG_SEVERITY_LOW:    return "low";
+	default:                       return "info";
+    }
+}
+
+static void GLAPIENTRY
+DebugCallback( GLenum source, GLenum type, GLuint id, GLenum severity,
+	       GLsizei length, const GLchar* message, const GLvoid* userParam )
+{
+    const GLCallSite*  site = (const GLCallSite*) userParam;
+
+    fprintf( stderr, "[GL %s, %s] %s (after %s:%d)\n", DebugTypeString(type),
+	     DebugSeverityString(severity), message, site->file, site->line );
+    fflush( stderr );
+}
+
+bool
+EnableGLDebugOutput( bool synchronous, const GLCallSite* site )
+{
+    if ( glDebugMessageCallback == NULL || glDebugMessageControl == NULL ||
+	 !(HasGLVersion( 4, 3 ) || HasGLExtension( "GL_KHR_debug" )) ) {
+	return false;
+    }
+
+    glEnable( GL_DEBUG_OUTPUT );
+    if ( synchronous ) { glEnable( GL_DEBUG_OUTPUT_SYNCHRONOUS ); }
+    glDebugMessageCallback( DebugCallback, site );
+
+    // Everything except notifications, which are mostly chatter about buffer placement
+    glDebugMessageControl( GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE );
+    glDebugMessageControl( GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION,
+			   0, NULL, GL_FALSE );
+    return true;
+}
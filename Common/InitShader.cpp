@@ -1,8 +1,21 @@
 
 #include "Angel.h"
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#  include <direct.h>
+#endif
 
 namespace Angel {
 
+// Reflection data for every program created by InitShader
+static ShaderInfo* shaderInfos = NULL;
+
+// The program binary cache (NULL when off), and what it has done
+static const char* shaderCacheDir = NULL;
+static ShaderCacheStats shaderCacheStats = { 0, 0 };
+
 // Create a NULL-terminated string by reading the provided file
 static char*
 readShaderSource(const char* shaderFile)
@@ -25,9 +38,281 @@ readShaderSource(const char* shaderFile)
 }
 
 
+// Fill in one ShaderVariable from glGetActiveUniform/glGetActiveAttrib
+static void
+reflectVariable( GLuint program, GLuint index, bool uniform, ShaderVariable& v )
+{
+    if ( uniform ) {
+	glGetActiveUniform( program, index, sizeof(v.name), NULL, &v.size, &v.type, v.name );
+    } else {
+	glGetActiveAttrib( program, index, sizeof(v.name), NULL, &v.size, &v.type, v.name );
+    }
+
+    // Arrays are reported as "name[0]" - record them under the base name
+    char* bracket = strchr( v.name, '[' );
+    if ( bracket != NULL ) { *bracket = '\0'; }
+
+    // Uniforms inside uniform blocks have no location (-1)
+    v.location = uniform ? glGetUniformLocation( program, v.name )
+			 : glGetAttribLocation( program, v.name );
+}
+
+// Enumerate the active uniforms and attributes of a linked program
+static void
+reflectProgram( GLuint program )
+{
+    ShaderInfo* info = new ShaderInfo;
+    info->program = program;
+
+    glGetProgramiv( program, GL_ACTIVE_UNIFORMS, &info->numUniforms );
+    info->uniforms = new ShaderVariable[info->numUniforms];
+    for ( int i = 0; i < info->numUniforms; ++i ) {
+	reflectVariable( program, i, true, info->uniforms[i] );
+    }
+
+    glGetProgramiv( program, GL_ACTIVE_ATTRIBUTES, &info->numAttributes );
+    info->attributes = new ShaderVariable[info->numAttributes];
+    for ( int i = 0; i < info->numAttributes; ++i ) {
+	reflectVariable( program, i, false, info->attributes[i] );
+    }
+
+    glGetProgramiv( program, GL_ACTIVE_UNIFORM_BLOCKS, &info->numUniformBlocks );
+    info->uniformBlocks = new ShaderBlock[info->numUniformBlocks];
+    for ( int i = 0; i < info->numUniformBlocks; ++i ) {
+	ShaderBlock& b = info->uniformBlocks[i];
+	b.index = i;
+	glGetActiveUniformBlockName( program, i, sizeof(b.name), NULL, b.name );
+	glGetActiveUniformBlockiv( program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &b.dataSize );
+    }
+
+    info->next = shaderInfos;
+    shaderInfos = info;
+}
+
+const ShaderInfo*
+GetShaderInfo( GLuint program )
+{
+    for ( ShaderInfo* info = shaderInfos; info != NULL; info = info->next ) {
+	if ( info->program == program ) { return info; }
+    }
+    return NULL;
+}
+
+static const ShaderVariable*
+findVariable( const ShaderVariable* vars, int count, const char* name )
+{
+    for ( int i = 0; i < count; ++i ) {
+	if ( strcmp( vars[i].name, name ) == 0 ) { return &vars[i]; }
+    }
+    return NULL;
+}
+
+const ShaderVariable*
+FindUniform( GLuint program, const char* name )
+{
+    const ShaderInfo* info = GetShaderInfo( program );
+    if ( info == NULL ) { return NULL; }
+    return findVariable( info->uniforms, info->numUniforms, name );
+}
+
+const ShaderVariable*
+FindAttribute( GLuint program, const char* name )
+{
+    const ShaderInfo* info = GetShaderInfo( program );
+    if ( info == NULL ) { return NULL; }
+    return findVariable( info->attributes, info->numAttributes, name );
+}
+
+const ShaderBlock*
+FindUniformBlock( GLuint program, const char* name )
+{
+    const ShaderInfo* info = GetShaderInfo( program );
+    if ( info == NULL ) { return NULL; }
+
+    for ( int i = 0; i < info->numUniformBlocks; ++i ) {
+	if ( strcmp( info->uniformBlocks[i].name, name ) == 0 ) {
+	    return &info->uniformBlocks[i];
+	}
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------------
+//
+//  --- Program binary cache ---
+//
+//  Each cache file is named by a 64-bit FNV-1a hash of everything that
+//    goes into the program, and holds a header then the driver's binary.
+//    The header repeats the hash, so a file from another build is never
+//    mistaken for this one.
+
+struct CacheHeader {
+    char      magic[4];     // "GLPB"
+    GLuint    hashLow, hashHigh;
+    GLenum    format;       // From glGetProgramBinary
+    GLsizei   length;       // Bytes of binary after the header
+};
+
+static void
+hashBytes( unsigned long long& hash, const char* s )
+{
+    for ( ; s != NULL && *s != '\0'; ++s ) {
+	hash = (hash ^ (unsigned char) *s) * 1099511628211ULL;
+    }
+    hash = (hash ^ 0xFF) * 1099511628211ULL;  // Separates consecutive strings
+}
+
+static unsigned long long
+programHash( const char* vSource, const char* fSource, const char* defines,
+	     const char* const* attributes )
+{
+    unsigned long long  hash = 14695981039346656037ULL;
+    hashBytes( hash, vSource );
+    hashBytes( hash, fSource );
+    hashBytes( hash, defines );
+    for ( int i = 0; attributes != NULL && attributes[i] != NULL; ++i ) {
+	hashBytes( hash, attributes[i] );
+    }
+
+    // A binary is only valid for the driver that made it
+    hashBytes( hash, (const char*) glGetString( GL_VENDOR ) );
+    hashBytes( hash, (const char*) glGetString( GL_RENDERER ) );
+    hashBytes( hash, (const char*) glGetString( GL_VERSION ) );
+    return hash;
+}
+
+static bool
+shaderCacheAvailable()
+{
+    if ( shaderCacheDir == NULL || glGetProgramBinary == NULL ||
+	 glProgramBinary == NULL || glProgramParameteri == NULL ||
+	 !(HasGLVersion( 4, 1 ) || HasGLExtension( "GL_ARB_get_program_binary" )) ) {
+	return false;
+    }
+
+    GLint  formats = 0;
+    glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &formats );
+    return formats > 0;
+}
+
+static void
+cacheFileName( char* name, size_t size, unsigned long long hash )
+{
+    snprintf( name, size, "%s/%08x%08x.bin", shaderCacheDir,
+	      (GLuint) (hash >> 32), (GLuint) hash );
+}
+
+// Load a cached binary into program, returning false (with program
+// unchanged) if there isn't one or the driver rejects it
+static bool
+loadCachedProgram( GLuint program, unsigned long long hash )
+{
+    char  name[512];
+    cacheFileName( name, sizeof(name), hash );
+    FILE* fp = fopen( name, "rb" );
+    if ( fp == NULL ) { return false; }
+
+    // The length must account for the rest of the file, so a corrupt or
+    // truncated file is never trusted with an allocation
+    long  fileSize = -1;
+    if ( fseek( fp, 0, SEEK_END ) == 0 ) { fileSize = ftell( fp ); }
+    rewind( fp );
+
+    CacheHeader  header;
+    bool  ok = fread( &header, sizeof(header), 1, fp ) == 1 &&
+	       memcmp( header.magic, "GLPB", 4 ) == 0 &&
+	       header.hashLow == (GLuint) hash &&
+	       header.hashHigh == (GLuint) (hash >> 32) &&
+	       header.length > 0 &&
+	       (long) header.length == fileSize - (long) sizeof(header);
+
+    char* binary = NULL;
+    if ( ok ) {
+	binary = new char[header.length];
+	ok = fread( binary, header.length, 1, fp ) == 1;
+    }
+    fclose( fp );
+
+    if ( ok ) {
+	glProgramBinary( program, header.format, binary, header.length );
+	GLint  linked;
+	glGetProgramiv( program, GL_LINK_STATUS, &linked );
+	ok = linked;
+    }
+    delete [] binary;
+    if ( !ok ) {
+	glGetError();  // A stale or unknown format is an error, but the program just compiles instead
+    }
+    return ok;
+}
+
+static void
+saveCachedProgram( GLuint program, unsigned long long hash )
+{
+    CacheHeader  header;
+    memcpy( header.magic, "GLPB", 4 );
+    header.hashLow = (GLuint) hash;
+    header.hashHigh = (GLuint) (hash >> 32);
+    header.format = 0;
+    header.length = 0;
+
+    GLint  length = 0;
+    glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length );
+    if ( length <= 0 ) { return; }
+    char* binary = new char[length];
+    glGetProgramBinary( program, length, &header.length, &header.format, binary );
+    if ( glGetError() != GL_NO_ERROR || header.length <= 0 || header.length > length ) {
+	delete [] binary;
+	return;
+    }
+
+#ifdef _WIN32
+    _mkdir( shaderCacheDir );
+#else
+    mkdir( shaderCacheDir, 0755 );
+#endif
+
+    // Write to a temporary name then rename, so a partial file is never read
+    char  name[512], tempName[520];
+    cacheFileName( name, sizeof(name), hash );
+    snprintf( tempName, sizeof(tempName), "%s.tmp", name );
+    FILE* fp = fopen( tempName, "wb" );
+    if ( fp != NULL ) {
+	bool  ok = fwrite( &header, sizeof(header), 1, fp ) == 1 &&
+		   fwrite( binary, header.length, 1, fp ) == 1;
+	ok = fclose( fp ) == 0 && ok;
+	remove( name );  // rename doesn't replace files on Windows
+	if ( !ok || rename( tempName, name ) != 0 ) { remove( tempName ); }
+    }
+    delete [] binary;
+}
+
+void
+SetShaderCacheDir( const char* dir )
+{
+    shaderCacheDir = dir;
+}
+
+ShaderCacheStats
+GetShaderCacheStats()
+{
+    return shaderCacheStats;
+}
+
+//----------------------------------------------------------------------------
+
 // Create a GLSL program object from vertex and fragment shader files
 GLuint
 InitShader(const char* vShaderFile, const char* fShaderFile)
+{
+    return InitShader( vShaderFile, fShaderFile, NULL, NULL );
+}
+
+// Create a GLSL program object from vertex and fragment shader files,
+// with defines inserted after the #version line of each
+GLuint
+InitShader(const char* vShaderFile, const char* fShaderFile,
+	   const char* defines, const char* const* attributes)
 {
     struct Shader {
 	const char*  filename;
@@ -39,7 +324,7 @@ InitShader(const char* vShaderFile, const char* fShaderFile)
     };
 
     GLuint program = glCreateProgram();
-    
+
     for ( int i = 0; i < 2; ++i ) {
 	Shader& s = shaders[i];
 	s.source = readShaderSource( s.filename );
@@ -47,9 +332,50 @@ InitShader(const char* vShaderFile, const char* fShaderFile)
 	    std::cerr << "Failed to read " << s.filename << std::endl;
 	    exit( EXIT_FAILURE );
 	}
+    }
+
+    /* try the binary cache before compiling */
+    bool cache = shaderCacheAvailable();
+    unsigned long long hash = 0;
+    if ( cache ) {
+	hash = programHash( shaders[0].source, shaders[1].source, defines, attributes );
+	if ( loadCachedProgram( program, hash ) ) {
+	    delete [] shaders[0].source;
+	    delete [] shaders[1].source;
+	    shaderCacheStats.loaded++;
+
+	    reflectProgram( program );
+	    glUseProgram( program );
+	    return program;
+	}
+    }
+
+    for ( int i = 0; i < 2; ++i ) {
+	Shader& s = shaders[i];
+
+	// The #version line must come first, so the defines go after it,
+	// then a #line directive keeps the line numbers in errors right
+	const GLchar* strings[4];
+	GLint lengths[4];
+	const char* body = s.source;
+	int n = 0;
+	if ( defines != NULL ) {
+	    if ( strncmp( body, "#version", 8 ) == 0 ) {
+		const char* newline = strchr( body, '\n' );
+		body = newline != NULL ? newline + 1 : body + strlen( body );
+		strings[n] = s.source;
+		lengths[n++] = body - s.source;
+	    }
+	    strings[n] = defines;
+	    lengths[n++] = -1;
+	    strings[n] = body == s.source ? "#line 1\n" : "#line 2\n";
+	    lengths[n++] = -1;
+	}
+	strings[n] = body;
+	lengths[n++] = -1;
 
 	GLuint shader = glCreateShader( s.type );
-	glShaderSource( shader, 1, (const GLchar**) &s.source, NULL );
+	glShaderSource( shader, n, strings, lengths );
 	glCompileShader( shader );
 
 	GLint  compiled;
@@ -71,7 +397,17 @@ InitShader(const char* vShaderFile, const char* fShaderFile)
 	glAttachShader( program, shader );
     }
 
+    /* fix attribute locations, so programs can share vertex arrays */
+    if ( attributes != NULL ) {
+	for ( GLuint i = 0; attributes[i] != NULL; ++i ) {
+	    glBindAttribLocation( program, i, attributes[i] );
+	}
+    }
+
     /* link  and error check */
+    if ( cache ) {
+	glProgramParameteri( program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+    }
     glLinkProgram(program);
 
     GLint  linked;
@@ -87,6 +423,13 @@ InitShader(const char* vShaderFile, const char* fShaderFile)
 
 	exit( EXIT_FAILURE );
     }
+    shaderCacheStats.compiled++;
+    if ( cache ) {
+	saveCachedProgram( program, hash );
+    }
+
+    /* record the active uniforms and attributes */
+    reflectProgram( program );
 
     /* use program object */
     glUseProgram(program);
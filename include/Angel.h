@@ -80,6 +80,65 @@ namespace Angel {
 GLuint InitShader( const char* vertexShaderFile,
 		   const char* fragmentShaderFile );
 
+//  As above, but with defines (lines such as "#define NAME 1\n") inserted
+//    after each file's #version line, and with attributes[i] bound to
+//    location i before linking (the list ends with NULL).  Either may be
+//    NULL.
+GLuint InitShader( const char* vertexShaderFile,
+		   const char* fragmentShaderFile,
+		   const char* defines,
+		   const char* const* attributes );
+
+//  Cache linked programs as driver binaries (glGetProgramBinary) in the
+//    directory dir, which is created if it doesn't exist.  InitShader then
+//    loads a program from the cache when its sources, defines, attributes
+//    and the driver (vendor, renderer and version) all match, and compiles
+//    it from source otherwise.  NULL, the default, turns caching off.  The
+//    cache also needs LoadGLExtra and OpenGL 4.1 or ARB_get_program_binary.
+void SetShaderCacheDir( const char* dir );
+
+//  How many programs InitShader has loaded from the cache and compiled
+struct ShaderCacheStats {
+    int  loaded;
+    int  compiled;
+};
+ShaderCacheStats GetShaderCacheStats();
+
+//  An active uniform or vertex attribute of a linked program.  Array
+//    uniforms are recorded once under their base name (without "[0]").
+struct ShaderVariable {
+    GLchar  name[64];
+    GLint   location;
+    GLenum  type;
+    GLint   size;   // Number of array elements (1 for non-arrays)
+};
+
+//  An active uniform block of a linked program
+struct ShaderBlock {
+    GLchar  name[64];
+    GLuint  index;
+    GLint   dataSize;   // Bytes needed to back the whole block
+};
+
+//  Reflection data gathered by InitShader when a program is linked
+struct ShaderInfo {
+    GLuint           program;
+    int              numUniforms;
+    ShaderVariable*  uniforms;
+    int              numAttributes;
+    ShaderVariable*  attributes;
+    int              numUniformBlocks;
+    ShaderBlock*     uniformBlocks;
+    ShaderInfo*      next;
+};
+
+//  Look up reflection data for a program created by InitShader.  The
+//    Find functions return NULL if the name isn't active in the program.
+const ShaderInfo*      GetShaderInfo( GLuint program );
+const ShaderVariable*  FindUniform( GLuint program, const char* name );
+const ShaderVariable*  FindAttribute( GLuint program, const char* name );
+const ShaderBlock*     FindUniformBlock( GLuint program, const char* name );
+
 //  Defined constant for when numbers are too small to be used in the
 //    denominator of a division operation.  This is only used if the
 //    DEBUG macro is defined.
@@ -93,6 +152,7 @@ const GLfloat  DegreesToRadians = M_PI / 180.0;
 #include "vec.h"
 #include "mat.h"
 #include "CheckError.h"
+#include "GLExtra.h"
 
 #define Print(x)  do { std::cerr << #x " = " << (x) << std::endl; } while(0)
 
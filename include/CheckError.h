@@ -11,8 +11,38 @@
 #include <GL/gl.h>
 
 //----------------------------------------------------------------------------
+//
+//  GL_CHECK_LEVEL selects how much GL error checking is compiled in:
+//    0 - none: CheckError() and CheckFrameErrors() compile to nothing
+//    1 - per frame: CheckError() just records where it is, and
+//          CheckFrameErrors() (once a frame) reports any errors since
+//    2 - per call: CheckError() calls glGetError (the default)
+//
+//  At levels 1 and 2 EnableGLDebugOutput (GLExtra.h) reports errors and
+//    driver warnings through KHR_debug as they happen, giving the last
+//    CheckError() location reached.
+//
+
+#ifndef GL_CHECK_LEVEL
+#define GL_CHECK_LEVEL  2
+#endif
+
+//  The most recent CheckError() location
+struct GLCallSite {
+    const char*  file;
+    int          line;
+};
+
+#if GL_CHECK_LEVEL >= 1
 
-static const char*
+static GLCallSite  glCallSite = { "(start)", 0 };
+
+//  Inline, so that translation units using neither (or only the one for
+//    their level) don't get unused function warnings
+
+//----------------------------------------------------------------------------
+
+static inline const char*
 ErrorString( GLenum error )
 {
     const char*  msg="";
@@ -33,11 +63,14 @@ ErrorString( GLenum error )
 
 //----------------------------------------------------------------------------
 
-static void
+static inline void
 _CheckError( const char* file, int line )
 {
     GLenum  error;
 
+    glCallSite.file = file;
+    glCallSite.line = line;
+
     while( (error = glGetError()) != GL_NO_ERROR ) {
 	fprintf( stderr, "[%s:%d] %s\n", file, line, ErrorString(error) );
         fflush( stderr );
@@ -54,7 +87,32 @@ _CheckError( const char* file, int line )
 
 //----------------------------------------------------------------------------
 
-#define CheckError()  _CheckError( __FILE__, __LINE__ )
+static inline void
+_CheckFrameErrors( const char* file, int line )
+{
+    GLenum  error;
+
+    while( (error = glGetError()) != GL_NO_ERROR ) {
+	fprintf( stderr, "[%s:%d] %s this frame (last check at %s:%d)\n", file, line,
+		 ErrorString(error), glCallSite.file, glCallSite.line );
+        fflush( stderr );
+    }
+}
+
+#endif // GL_CHECK_LEVEL >= 1
+
+//----------------------------------------------------------------------------
+
+#if GL_CHECK_LEVEL >= 2
+#  define CheckError()  _CheckError( __FILE__, __LINE__ )
+#  define CheckFrameErrors()  ((void) 0)
+#elif GL_CHECK_LEVEL == 1
+#  define CheckError()  (glCallSite.file = __FILE__, glCallSite.line = __LINE__)
+#  define CheckFrameErrors()  _CheckFrameErrors( __FILE__, __LINE__ )
+#else
+#  define CheckError()  ((void) 0)
+#  define CheckFrameErrors()  ((void) 0)
+#endif
 
 //----------------------------------------------------------------------------
 
@@ -0,0 +1,139 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- GLExtra.h ---
+//
+//   Entry points and tokens newer than the bundled GL/glew.h.  These are
+//     loaded at run time by LoadGLExtra (call it after glewInit), and are
+//     NULL when the driver doesn't provide them - check HasGLVersion or
+//     HasGLExtension before use.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __GLEXTRA_H__
+#define __GLEXTRA_H__
+
+//----------------------------------------------------------------------------
+//
+//  --- GL_ARB_buffer_storage (core in OpenGL 4.4) ---
+//
+
+#ifndef GL_ARB_buffer_storage
+#define GL_MAP_PERSISTENT_BIT   0x0040
+#define GL_MAP_COHERENT_BIT     0x0080
+#define GL_DYNAMIC_STORAGE_BIT  0x0100
+#define GL_CLIENT_STORAGE_BIT   0x0200
+
+typedef void (GLAPIENTRY * PFNGLBUFFERSTORAGEPROC) ( GLenum target, GLsizeiptr size, const GLvoid* data, GLbitfield flags );
+#endif
+
+#ifndef glBufferStorage
+extern PFNGLBUFFERSTORAGEPROC  glextBufferStorage;
+#  define glBufferStorage  glextBufferStorage
+#  define GLEXTRA_BUFFER_STORAGE
+#endif
+
+//----------------------------------------------------------------------------
+//
+//  --- GL_ARB_multi_draw_indirect (core in OpenGL 4.3) ---
+//
+
+#ifndef GL_ARB_multi_draw_indirect
+typedef void (GLAPIENTRY * PFNGLMULTIDRAWELEMENTSINDIRECTPROC) ( GLenum mode, GLenum type, const GLvoid* indirect, GLsizei drawcount, GLsizei stride );
+#endif
+
+#ifndef glMultiDrawElementsIndirect
+extern PFNGLMULTIDRAWELEMENTSINDIRECTPROC  glextMultiDrawElementsIndirect;
+#  define glMultiDrawElementsIndirect  glextMultiDrawElementsIndirect
+#  define GLEXTRA_MULTI_DRAW_INDIRECT
+#endif
+
+//----------------------------------------------------------------------------
+//
+//  --- GL_KHR_debug (core in OpenGL 4.3) ---
+//
+
+#ifndef GL_KHR_debug
+#define GL_CONTEXT_FLAG_DEBUG_BIT          0x00000002
+#define GL_DEBUG_OUTPUT_SYNCHRONOUS        0x8242
+#define GL_DEBUG_SOURCE_API                0x8246
+#define GL_DEBUG_SOURCE_WINDOW_SYSTEM      0x8247
+#define GL_DEBUG_SOURCE_SHADER_COMPILER    0x8248
+#define GL_DEBUG_SOURCE_THIRD_PARTY        0x8249
+#define GL_DEBUG_SOURCE_APPLICATION        0x824A
+#define GL_DEBUG_SOURCE_OTHER              0x824B
+#define GL_DEBUG_TYPE_ERROR                0x824C
+#define GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR  0x824D
+#define GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR   0x824E
+#define GL_DEBUG_TYPE_PORTABILITY          0x824F
+#define GL_DEBUG_TYPE_PERFORMANCE          0x8250
+#define GL_DEBUG_TYPE_OTHER                0x8251
+#define GL_DEBUG_SEVERITY_NOTIFICATION     0x826B
+#define GL_DEBUG_SEVERITY_HIGH             0x9146
+#define GL_DEBUG_SEVERITY_MEDIUM           0x9147
+#define GL_DEBUG_SEVERITY_LOW              0x9148
+#define GL_DEBUG_OUTPUT                    0x92E0
+
+typedef void (GLAPIENTRY * GLDEBUGPROC) ( GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const GLvoid* userParam );
+typedef void (GLAPIENTRY * PFNGLDEBUGMESSAGECALLBACKPROC) ( GLDEBUGPROC callback, const GLvoid* userParam );
+typedef void (GLAPIENTRY * PFNGLDEBUGMESSAGECONTROLPROC) ( GLenum source, GLenum type, GLenum severity, GLsizei count, const GLuint* ids, GLboolean enabled );
+#endif
+
+#ifndef glDebugMessageCallback
+extern PFNGLDEBUGMESSAGECALLBACKPROC  glextDebugMessageCallback;
+extern PFNGLDEBUGMESSAGECONTROLPROC   glextDebugMessageControl;
+#  define glDebugMessageCallback  glextDebugMessageCallback
+#  define glDebugMessageControl   glextDebugMessageControl
+#  define GLEXTRA_DEBUG
+#endif
+
+//----------------------------------------------------------------------------
+//
+//  --- GL_ARB_get_program_binary (core in OpenGL 4.1) ---
+//
+
+#ifndef GL_ARB_get_program_binary
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT  0x8257
+#define GL_PROGRAM_BINARY_LENGTH            0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS       0x87FE
+#define GL_PROGRAM_BINARY_FORMATS           0x87FF
+
+typedef void (GLAPIENTRY * PFNGLGETPROGRAMBINARYPROC) ( GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, GLvoid* binary );
+typedef void (GLAPIENTRY * PFNGLPROGRAMBINARYPROC) ( GLuint program, GLenum binaryFormat, const GLvoid* binary, GLsizei length );
+typedef void (GLAPIENTRY * PFNGLPROGRAMPARAMETERIPROC) ( GLuint program, GLenum pname, GLint value );
+#endif
+
+#ifndef glGetProgramBinary
+extern PFNGLGETPROGRAMBINARYPROC   glextGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC      glextProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC  glextProgramParameteri;
+#  define glGetProgramBinary   glextGetProgramBinary
+#  define glProgramBinary      glextProgramBinary
+#  define glProgramParameteri  glextProgramParameteri
+#  define GLEXTRA_PROGRAM_BINARY
+#endif
+
+//----------------------------------------------------------------------------
+//
+//  --- Loading and capability checks ---
+//
+
+typedef void (*GLExtraProc)( void );
+
+//  Load the entry points above for the current context.  getProcAddress
+//    defaults to the window system's loader (glX or wgl).
+void LoadGLExtra( GLExtraProc (*getProcAddress)( const char* ) = NULL );
+
+//  True if the current context is at least the given OpenGL version
+bool HasGLVersion( int major, int minor );
+
+//  True if the current context advertises the named extension
+bool HasGLExtension( const char* name );
+
+//  Report GL errors and driver warnings (performance, undefined behaviour,
+//    ...) on stderr through KHR_debug, with the location in site (see
+//    CheckError.h).  Synchronous output reports each message during the
+//    call that caused it, at some cost.  Returns false if KHR_debug isn't
+//    available.
+bool EnableGLDebugOutput( bool synchronous, const GLCallSite* site );
+
+#endif // !__GLEXTRA_H__
@@ -8,6 +8,9 @@
 #define __ANGEL_MAT_H__
 
 #include <stdio.h>
+#if __cplusplus >= 201402L
+#include <type_traits>
+#endif
 #include "vec.h"
 
 namespace Angel {
@@ -35,13 +38,6 @@ class mat2 {
     mat2( GLfloat m00, GLfloat m10, GLfloat m01, GLfloat m11 )
 	{ _m[0] = vec2( m00, m01 ); _m[1] = vec2( m10, m11 ); }
 
-    mat2( const mat2& m ) {
-	if ( *this != m ) {
-	    _m[0] = m._m[0];
-	    _m[1] = m._m[1];
-	} 
-    }
-
     //
     //  --- Indexing Operator ---
     //
@@ -213,15 +209,6 @@ class mat3 {
 	    _m[2] = vec3( m20, m21, m22 );
 	}
 
-    mat3( const mat3& m )
-	{
-	    if ( *this != m ) {
-		_m[0] = m._m[0];
-		_m[1] = m._m[1];
-		_m[2] = m._m[2];
-	    } 
-	}
-
     //
     //  --- Indexing Operator ---
     //
@@ -375,6 +362,11 @@ mat3 transpose( const mat3& A ) {
 //
 //  mat4.h - 4D square matrix
 //
+//    Stored as four rows (vec4s), so it's 16-byte aligned and trivially
+//    copyable too.  The products work a row at a time in SIMD registers (see
+//    vec.h), adding in the same order as the element-by-element versions, so
+//    they give the same results.
+//
 
 class mat4 {
 
@@ -402,16 +394,6 @@ class mat4 {
 	    _m[3] = vec4( m30, m31, m32, m33 );
 	}
 
-    mat4( const mat4& m )
-	{
-	    if ( *this != m ) {
-		_m[0] = m._m[0];
-		_m[1] = m._m[1];
-		_m[2] = m._m[2];
-		_m[3] = m._m[3];
-	    } 
-	}
-
     //
     //  --- Indexing Operator ---
     //
@@ -448,18 +430,12 @@ class mat4 {
     friend mat4 operator * ( const GLfloat s, const mat4& m )
 	{ return m * s; }
 	
+    //  Each row of the product is the rows of m weighted by the elements of
+    //    the same row of this
     mat4 operator * ( const mat4& m ) const {
-	mat4  a( 0.0 );
-
-	for ( int i = 0; i < 4; ++i ) {
-	    for ( int j = 0; j < 4; ++j ) {
-		for ( int k = 0; k < 4; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
-		}
-	    }
-	}
-
-	return a;
+	simd4  b0 = m._m[0].simd(), b1 = m._m[1].simd(), b2 = m._m[2].simd(), b3 = m._m[3].simd();
+	return mat4( combineRows( _m[0], b0, b1, b2, b3 ), combineRows( _m[1], b0, b1, b2, b3 ),
+		     combineRows( _m[2], b0, b1, b2, b3 ), combineRows( _m[3], b0, b1, b2, b3 ) );
     }
 
     //
@@ -481,19 +457,8 @@ class mat4 {
 	return *this;
     }
 
-    mat4& operator *= ( const mat4& m ) {
-	mat4  a( 0.0 );
-
-	for ( int i = 0; i < 4; ++i ) {
-	    for ( int j = 0; j < 4; ++j ) {
-		for ( int k = 0; k < 4; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
-		}
-	    }
-	}
-
-	return *this = a;
-    }
+    mat4& operator *= ( const mat4& m )
+	{ return *this = *this * m; }
 
     mat4& operator /= ( const GLfloat s ) {
 #ifdef DEBUG
@@ -512,12 +477,14 @@ class mat4 {
     //  --- Matrix / Vector operators ---
     //
 
+    //  The products of each row with v, transposed so that adding them up
+    //    sums each row's
     vec4 operator * ( const vec4& v ) const {  // m * v
-	return vec4( _m[0][0]*v.x + _m[0][1]*v.y + _m[0][2]*v.z + _m[0][3]*v.w,
-		     _m[1][0]*v.x + _m[1][1]*v.y + _m[1][2]*v.z + _m[1][3]*v.w,
-		     _m[2][0]*v.x + _m[2][1]*v.y + _m[2][2]*v.z + _m[2][3]*v.w,
-		     _m[3][0]*v.x + _m[3][1]*v.y + _m[3][2]*v.z + _m[3][3]*v.w
-	    );
+	simd4  s = v.simd();
+	simd4  p0 = simdMul( _m[0].simd(), s ), p1 = simdMul( _m[1].simd(), s );
+	simd4  p2 = simdMul( _m[2].simd(), s ), p3 = simdMul( _m[3].simd(), s );
+	simdTranspose( p0, p1, p2, p3 );
+	return vec4( simdAdd( simdAdd( simdAdd( p0, p1 ), p2 ), p3 ) );
     }
 	
     //
@@ -544,27 +511,69 @@ class mat4 {
 
     operator GLfloat* ()
 	{ return static_cast<GLfloat*>( &_m[0].x ); }
+
+   private:
+    //  w[0]*b0 + w[1]*b1 + w[2]*b2 + w[3]*b3
+    static vec4 combineRows( const vec4& w, simd4 b0, simd4 b1, simd4 b2, simd4 b3 ) {
+	simd4  r = simdMul( simdSplat( w.x ), b0 );
+	r = simdMulAdd( simdSplat( w.y ), b1, r );
+	r = simdMulAdd( simdSplat( w.z ), b2, r );
+	return vec4( simdMulAdd( simdSplat( w.w ), b3, r ) );
+    }
 };
 
+#if __cplusplus >= 201402L
+static_assert( std::is_trivially_copyable<vec4>::value && std::is_trivially_copyable<mat4>::value
+	       && alignof(vec4) == 16 && alignof(mat4) == 16,
+	       "vec4 and mat4 must be plain aligned data" );
+#endif
+
 //
 //  --- Non-class mat4 Methods ---
 //
 
 inline
 mat4 matrixCompMult( const mat4& A, const mat4& B ) {
-    return mat4(
-	A[0][0]*B[0][0], A[0][1]*B[0][1], A[0][2]*B[0][2], A[0][3]*B[0][3],
-	A[1][0]*B[1][0], A[1][1]*B[1][1], A[1][2]*B[1][2], A[1][3]*B[1][3],
-	A[2][0]*B[2][0], A[2][1]*B[2][1], A[2][2]*B[2][2], A[2][3]*B[2][3],
-	A[3][0]*B[3][0], A[3][1]*B[3][1], A[3][2]*B[3][2], A[3][3]*B[3][3] );
+    return mat4( A[0]*B[0], A[1]*B[1], A[2]*B[2], A[3]*B[3] );
 }
 
 inline
 mat4 transpose( const mat4& A ) {
-    return mat4( A[0][0], A[1][0], A[2][0], A[3][0],
-		 A[0][1], A[1][1], A[2][1], A[3][1],
-		 A[0][2], A[1][2], A[2][2], A[3][2],
-		 A[0][3], A[1][3], A[2][3], A[3][3] );
+    simd4  r0 = A[0].simd(), r1 = A[1].simd(), r2 = A[2].simd(), r3 = A[3].simd();
+    simdTranspose( r0, r1, r2, r3 );
+    return mat4( vec4( r0 ), vec4( r1 ), vec4( r2 ), vec4( r3 ) );
+}
+
+//  The inverse, by cofactors (built from the 2x2 determinants of the top
+//    and bottom pairs of rows).  A singular matrix gives infinities.
+inline
+mat4 inverse( const mat4& A ) {
+    GLfloat s0 = A[0][0]*A[1][1] - A[1][0]*A[0][1];
+    GLfloat s1 = A[0][0]*A[1][2] - A[1][0]*A[0][2];
+    GLfloat s2 = A[0][0]*A[1][3] - A[1][0]*A[0][3];
+    GLfloat s3 = A[0][1]*A[1][2] - A[1][1]*A[0][2];
+    GLfloat s4 = A[0][1]*A[1][3] - A[1][1]*A[0][3];
+    GLfloat s5 = A[0][2]*A[1][3] - A[1][2]*A[0][3];
+
+    GLfloat c5 = A[2][2]*A[3][3] - A[3][2]*A[2][3];
+    GLfloat c4 = A[2][1]*A[3][3] - A[3][1]*A[2][3];
+    GLfloat c3 = A[2][1]*A[3][2] - A[3][1]*A[2][2];
+    GLfloat c2 = A[2][0]*A[3][3] - A[3][0]*A[2][3];
+    GLfloat c1 = A[2][0]*A[3][2] - A[3][0]*A[2][2];
+    GLfloat c0 = A[2][0]*A[3][1] - A[3][0]*A[2][1];
+
+    GLfloat d = 1.0 / (s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0);
+
+    mat4  B;
+    B[0] = vec4( A[1][1]*c5 - A[1][2]*c4 + A[1][3]*c3, -A[0][1]*c5 + A[0][2]*c4 - A[0][3]*c3,
+		 A[3][1]*s5 - A[3][2]*s4 + A[3][3]*s3, -A[2][1]*s5 + A[2][2]*s4 - A[2][3]*s3 ) * d;
+    B[1] = vec4( -A[1][0]*c5 + A[1][2]*c2 - A[1][3]*c1, A[0][0]*c5 - A[0][2]*c2 + A[0][3]*c1,
+		 -A[3][0]*s5 + A[3][2]*s2 - A[3][3]*s1, A[2][0]*s5 - A[2][2]*s2 + A[2][3]*s1 ) * d;
+    B[2] = vec4( A[1][0]*c4 - A[1][1]*c2 + A[1][3]*c0, -A[0][0]*c4 + A[0][1]*c2 - A[0][3]*c0,
+		 A[3][0]*s4 - A[3][1]*s2 + A[3][3]*s0, -A[2][0]*s4 + A[2][1]*s2 - A[2][3]*s0 ) * d;
+    B[3] = vec4( -A[1][0]*c3 + A[1][1]*c1 - A[1][2]*c0, A[0][0]*c3 - A[0][1]*c1 + A[0][2]*c0,
+		 -A[3][0]*s3 + A[3][1]*s1 - A[3][2]*s0, A[2][0]*s3 - A[2][1]*s1 + A[2][2]*s0 ) * d;
+    return B;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -9,8 +9,123 @@
 
 #include "Angel.h"
 
+//  vec4 and mat4 do their arithmetic four floats at a time: with SSE on x86
+//    (always there on x86-64), with NEON on ARM, and otherwise with plain
+//    loops the compiler may still vectorize.
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#  include <xmmintrin.h>
+#  define ANGEL_SSE
+#  define ANGEL_SIMD_NAME  "SSE"
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#  define ANGEL_NEON
+#  define ANGEL_SIMD_NAME  "NEON"
+#else
+#  define ANGEL_SIMD_NAME  "scalar code"
+#endif
+
+#ifdef _MSC_VER
+#  define ANGEL_ALIGN16  __declspec(align(16))
+#else
+#  define ANGEL_ALIGN16  __attribute__((aligned(16)))
+#endif
+
 namespace Angel {
 
+//////////////////////////////////////////////////////////////////////////////
+//
+//  simd4 - four floats in a SIMD register
+//
+//    Loads and stores are unaligned ones, which cost nothing extra on aligned
+//    data: vec4 and mat4 are 16-byte aligned, but heap blocks aren't always
+//    (e.g. from 32-bit MinGW's malloc).
+//
+
+#if defined(ANGEL_SSE)
+
+typedef __m128  simd4;
+
+inline simd4 simdLoad( const GLfloat* p ) { return _mm_loadu_ps( p ); }
+inline void simdStore( GLfloat* p, simd4 a ) { _mm_storeu_ps( p, a ); }
+inline simd4 simdSplat( GLfloat s ) { return _mm_set1_ps( s ); }
+inline simd4 simdAdd( simd4 a, simd4 b ) { return _mm_add_ps( a, b ); }
+inline simd4 simdSub( simd4 a, simd4 b ) { return _mm_sub_ps( a, b ); }
+inline simd4 simdMul( simd4 a, simd4 b ) { return _mm_mul_ps( a, b ); }
+
+inline GLfloat simdSum( simd4 a ) {  // Of the four lanes
+    simd4 t = _mm_add_ps( a, _mm_movehl_ps( a, a ) );
+    return _mm_cvtss_f32( _mm_add_ss( t, _mm_shuffle_ps( t, t, 1 ) ) );
+}
+
+inline void simdTranspose( simd4& r0, simd4& r1, simd4& r2, simd4& r3 )
+    { _MM_TRANSPOSE4_PS( r0, r1, r2, r3 ); }
+
+#elif defined(ANGEL_NEON)
+
+typedef float32x4_t  simd4;
+
+inline simd4 simdLoad( const GLfloat* p ) { return vld1q_f32( p ); }
+inline void simdStore( GLfloat* p, simd4 a ) { vst1q_f32( p, a ); }
+inline simd4 simdSplat( GLfloat s ) { return vdupq_n_f32( s ); }
+inline simd4 simdAdd( simd4 a, simd4 b ) { return vaddq_f32( a, b ); }
+inline simd4 simdSub( simd4 a, simd4 b ) { return vsubq_f32( a, b ); }
+inline simd4 simdMul( simd4 a, simd4 b ) { return vmulq_f32( a, b ); }
+
+inline GLfloat simdSum( simd4 a ) {  // Of the four lanes
+    float32x2_t t = vadd_f32( vget_low_f32( a ), vget_high_f32( a ) );
+    return vget_lane_f32( vpadd_f32( t, t ), 0 );
+}
+
+inline void simdTranspose( simd4& r0, simd4& r1, simd4& r2, simd4& r3 ) {
+    float32x4x2_t t01 = vtrnq_f32( r0, r1 );  // a0 b0 a2 b2, a1 b1 a3 b3
+    float32x4x2_t t23 = vtrnq_f32( r2, r3 );
+    r0 = vcombine_f32( vget_low_f32( t01.val[0] ), vget_low_f32( t23.val[0] ) );
+    r1 = vcombine_f32( vget_low_f32( t01.val[1] ), vget_low_f32( t23.val[1] ) );
+    r2 = vcombine_f32( vget_high_f32( t01.val[0] ), vget_high_f32( t23.val[0] ) );
+    r3 = vcombine_f32( vget_high_f32( t01.val[1] ), vget_high_f32( t23.val[1] ) );
+}
+
+#else
+
+struct simd4 { GLfloat v[4]; };
+
+inline simd4 simdLoad( const GLfloat* p )
+    { simd4 a = {{ p[0], p[1], p[2], p[3] }};  return a; }
+inline void simdStore( GLfloat* p, simd4 a )
+    { p[0] = a.v[0];  p[1] = a.v[1];  p[2] = a.v[2];  p[3] = a.v[3]; }
+inline simd4 simdSplat( GLfloat s ) { simd4 a = {{ s, s, s, s }};  return a; }
+
+inline simd4 simdAdd( simd4 a, simd4 b ) {
+    simd4 c = {{ a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] }};
+    return c;
+}
+inline simd4 simdSub( simd4 a, simd4 b ) {
+    simd4 c = {{ a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] }};
+    return c;
+}
+inline simd4 simdMul( simd4 a, simd4 b ) {
+    simd4 c = {{ a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] }};
+    return c;
+}
+
+inline GLfloat simdSum( simd4 a )  // Of the four lanes
+    { return (a.v[0] + a.v[2]) + (a.v[1] + a.v[3]); }
+
+inline void simdTranspose( simd4& r0, simd4& r1, simd4& r2, simd4& r3 ) {
+    simd4 c0 = {{ r0.v[0], r1.v[0], r2.v[0], r3.v[0] }};
+    simd4 c1 = {{ r0.v[1], r1.v[1], r2.v[1], r3.v[1] }};
+    simd4 c2 = {{ r0.v[2], r1.v[2], r2.v[2], r3.v[2] }};
+    simd4 c3 = {{ r0.v[3], r1.v[3], r2.v[3], r3.v[3] }};
+    r0 = c0;  r1 = c1;  r2 = c2;  r3 = c3;
+}
+
+#endif
+
+//  a * b + c (not fused, so it rounds like the scalar code)
+inline simd4 simdMulAdd( simd4 a, simd4 b, simd4 c )
+    { return simdAdd( simdMul( a, b ), c ); }
+
 //////////////////////////////////////////////////////////////////////////////
 //
 //  vec2.h - 2D vector
@@ -31,9 +146,6 @@ struct vec2 {
     vec2( GLfloat x, GLfloat y ) :
 	x(x), y(y) {}
 
-    vec2( const vec2& v )
-	{ x = v.x;  y = v.y;  }
-
     //
     //  --- Indexing Operator ---
     //
@@ -170,8 +282,6 @@ struct vec3 {
     vec3( GLfloat x, GLfloat y, GLfloat z ) :
 	x(x), y(y), z(z) {}
 
-    vec3( const vec3& v ) { x = v.x;  y = v.y;  z = v.z; }
-
     vec3( const vec2& v, const float f ) { x = v.x;  y = v.y;  z = f; }
 
     //
@@ -301,9 +411,12 @@ vec3 cross(const vec3& a, const vec3& b )
 //
 //  vec4 - 4D vector
 //
+//    16-byte aligned and trivially copyable, so arrays of them can be
+//    memcpy'd and loaded straight into SIMD registers.
+//
 //////////////////////////////////////////////////////////////////////////////
 
-struct vec4 {
+struct ANGEL_ALIGN16 vec4 {
 
     GLfloat  x;
     GLfloat  y;
@@ -320,7 +433,7 @@ struct vec4 {
     vec4( GLfloat x, GLfloat y, GLfloat z, GLfloat w ) :
 	x(x), y(y), z(z), w(w) {}
 
-    vec4( const vec4& v ) { x = v.x;  y = v.y;  z = v.z;  w = v.w; }
+    explicit vec4( simd4 v ) { simdStore( &x, v ); }
 
     vec4( const vec3& v, const float w = 1.0 ) : w(w)
 	{ x = v.x;  y = v.y;  z = v.z; }
@@ -335,24 +448,27 @@ struct vec4 {
     GLfloat& operator [] ( int i ) { return *(&x + i); }
     const GLfloat operator [] ( int i ) const { return *(&x + i); }
 
+    //  The four components in a SIMD register
+    simd4 simd() const { return simdLoad( &x ); }
+
     //
     //  --- (non-modifying) Arithematic Operators ---
     //
 
     vec4 operator - () const  // unary minus operator
-	{ return vec4( -x, -y, -z, -w ); }
+	{ return vec4( simdMul( simd(), simdSplat( -1.0f ) ) ); }
 
     vec4 operator + ( const vec4& v ) const
-	{ return vec4( x + v.x, y + v.y, z + v.z, w + v.w ); }
+	{ return vec4( simdAdd( simd(), v.simd() ) ); }
 
     vec4 operator - ( const vec4& v ) const
-	{ return vec4( x - v.x, y - v.y, z - v.z, w - v.w ); }
+	{ return vec4( simdSub( simd(), v.simd() ) ); }
 
     vec4 operator * ( const GLfloat s ) const
-	{ return vec4( s*x, s*y, s*z, s*w ); }
+	{ return vec4( simdMul( simd(), simdSplat( s ) ) ); }
 
     vec4 operator * ( const vec4& v ) const
-	{ return vec4( x*v.x, y*v.y, z*v.z, w*v.z ); }
+	{ return vec4( simdMul( simd(), v.simd() ) ); }
 
     friend vec4 operator * ( const GLfloat s, const vec4& v )
 	{ return v * s; }
@@ -375,16 +491,16 @@ struct vec4 {
     //
 
     vec4& operator += ( const vec4& v )
-	{ x += v.x;  y += v.y;  z += v.z;  w += v.w;  return *this; }
+	{ simdStore( &x, simdAdd( simd(), v.simd() ) );  return *this; }
 
     vec4& operator -= ( const vec4& v )
-	{ x -= v.x;  y -= v.y;  z -= v.z;  w -= v.w;  return *this; }
+	{ simdStore( &x, simdSub( simd(), v.simd() ) );  return *this; }
 
     vec4& operator *= ( const GLfloat s )
-	{ x *= s;  y *= s;  z *= s;  w *= s;  return *this; }
+	{ simdStore( &x, simdMul( simd(), simdSplat( s ) ) );  return *this; }
 
     vec4& operator *= ( const vec4& v )
-	{ x *= v.x, y *= v.y, z *= v.z, w *= v.w;  return *this; }
+	{ simdStore( &x, simdMul( simd(), v.simd() ) );  return *this; }
 
     vec4& operator /= ( const GLfloat s ) {
 #ifdef DEBUG
@@ -430,7 +546,7 @@ struct vec4 {
 
 inline
 GLfloat dot( const vec4& u, const vec4& v ) {
-    return u.x*v.x + u.y*v.y + u.z*v.z + u.w+v.w;
+    return simdSum( simdMul( u.simd(), v.simd() ) );
 }
 
 inline
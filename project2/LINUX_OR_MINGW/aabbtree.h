@@ -0,0 +1,666 @@
+// Dynamic AABB tree over the scene's objects (aabbtree.h)
+
+// Every object has a leaf holding its world space box, enlarged by a margin ("fat") so
+// that small moves, like a step of a walk, stay inside it and don't change the tree.  A
+// leaf is only taken out and inserted again when its object leaves the fat box.  Inserting
+// walks down from the root towards the cheapest place by surface area.  Every node changed
+// on the way back up is rebalanced by rotating its taller child up (as in AVL trees), which
+// keeps the tree shallow, then has its grandchildren swapped about if that shrinks its
+// children's boxes, which keeps queries fast however the objects were added.
+//
+// The scene keeps the tree in step with its objects as their model matrices are rebuilt
+// (see renderFrame), and uses it for frustum culling, picking (see picking.h) and to find
+// lights that reach no visible object (see lights.h).  --bench-tree times it against
+// linear scans, from 1K to 1M objects.
+
+const int aabbStackSize = 256;  // Deeper than any balanced tree of ints
+
+typedef struct {
+	float boxMin[3], boxMax[3];  // Fat, for leaves
+	int parent;  // On the free list: the next free node
+	int child[2];  // -1 for leaves
+	int height;  // 0 for leaves, -1 for free nodes
+	int item;  // The object, for leaves
+} TreeNode;
+
+typedef struct {
+	TreeNode *nodes;
+	int nodeCapacity;
+	int root;  // -1 when empty
+	int freeList;
+	int nLeaves;
+	int reinserts;  // Leaves moved out of their fat boxes, for the stats
+} AABBTree;
+
+void aabbReset(AABBTree *t) {
+	t->root = -1;
+	t->freeList = -1;
+	t->nLeaves = 0;
+	for (int n = t->nodeCapacity - 1; n >= 0; n--) {
+		t->nodes[n].height = -1;
+		t->nodes[n].parent = t->freeList;
+		t->freeList = n;
+	}
+}
+
+static int aabbAllocNode(AABBTree *t) {
+	if (t->freeList < 0) {
+		int old = t->nodeCapacity;
+		t->nodeCapacity = max(256, old * 2);
+		t->nodes = (TreeNode*) realloc(t->nodes, sizeof(TreeNode) * t->nodeCapacity);
+		if (t->nodes == NULL) {
+			failInt("Error - out of memory for AABB tree nodes:", t->nodeCapacity);
+		}
+		for (int n = t->nodeCapacity - 1; n >= old; n--) {
+			t->nodes[n].height = -1;
+			t->nodes[n].parent = t->freeList;
+			t->freeList = n;
+		}
+	}
+	int n = t->freeList;
+	t->freeList = t->nodes[n].parent;
+	t->nodes[n].parent = -1;
+	t->nodes[n].child[0] = t->nodes[n].child[1] = -1;
+	t->nodes[n].height = 0;
+	return n;
+}
+
+static void aabbFreeNode(AABBTree *t, int n) {
+	t->nodes[n].height = -1;
+	t->nodes[n].parent = t->freeList;
+	t->freeList = n;
+}
+
+// Half the surface area of a box, or of the union of two.
+static inline float aabbArea(const float *lo, const float *hi) {
+	float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+	return dx * dy + dy * dz + dz * dx;
+}
+
+static inline float aabbUnionArea(const TreeNode *a, const float *lo, const float *hi) {
+	float u[3], v[3];
+	for (int c = 0; c < 3; c++) {
+		u[c] = min(a->boxMin[c], lo[c]);
+		v[c] = max(a->boxMax[c], hi[c]);
+	}
+	return aabbArea(u, v);
+}
+
+// Set an inner node's box and height from its children.
+static void aabbRefitNode(AABBTree *t, int n) {
+	TreeNode *node = &t->nodes[n];
+	const TreeNode *a = &t->nodes[node->child[0]], *b = &t->nodes[node->child[1]];
+	for (int c = 0; c < 3; c++) {
+		node->boxMin[c] = min(a->boxMin[c], b->boxMin[c]);
+		node->boxMax[c] = max(a->boxMax[c], b->boxMax[c]);
+	}
+	node->height = 1 + max(a->height, b->height);
+}
+
+// If one child of node a is more than one level taller than the other, rotate it up to
+// take a's place.  a moves down to be its child, in place of its shorter child.  Returns
+// the node now where a was.
+static int aabbBalance(AABBTree *t, int a) {
+	TreeNode *A = &t->nodes[a];
+	if (A->height < 2) return a;
+
+	int diff = t->nodes[A->child[1]].height - t->nodes[A->child[0]].height;
+	if (diff >= -1 && diff <= 1) return a;
+	int up = diff > 1 ? 1 : 0;
+	int c = A->child[up];
+	TreeNode *C = &t->nodes[c];
+
+	// C takes A's place under A's parent.
+	C->parent = A->parent;
+	if (C->parent < 0) {
+		t->root = c;
+	} else {
+		TreeNode *P = &t->nodes[C->parent];
+		P->child[P->child[0] == a ? 0 : 1] = c;
+	}
+
+	// C keeps its taller child, and gives the other to A in its own place.
+	int f = C->child[0], g = C->child[1];
+	int keep = t->nodes[f].height > t->nodes[g].height ? f : g, give = keep == f ? g : f;
+	C->child[0] = a;
+	C->child[1] = keep;
+	A->parent = c;
+	A->child[up] = give;
+	t->nodes[give].parent = a;
+
+	aabbRefitNode(t, a);
+	aabbRefitNode(t, c);
+	return c;
+}
+
+static inline float aabbNodeArea(const AABBTree *t, int n) {
+	return aabbArea(t->nodes[n].boxMin, t->nodes[n].boxMax);
+}
+
+static inline float aabbPairArea(const AABBTree *t, int a, int b) {
+	return aabbUnionArea(&t->nodes[a], t->nodes[b].boxMin, t->nodes[b].boxMax);
+}
+
+// Swap two nodes that aren't ancestors of each other, with their subtrees.
+static void aabbSwapNodes(AABBTree *t, int p, int q) {
+	int pp = t->nodes[p].parent, qp = t->nodes[q].parent;
+	int ps = t->nodes[pp].child[0] == p ? 0 : 1, qs = t->nodes[qp].child[0] == q ? 0 : 1;
+	t->nodes[pp].child[ps] = q;
+	t->nodes[qp].child[qs] = p;
+	t->nodes[p].parent = qp;
+	t->nodes[q].parent = pp;
+}
+
+// Rotate node a's subtree to shrink its children's total area, if it can: swap one child
+// with one of the other child's children, or a child of each.  This is what keeps the tree
+// good for queries as items come and go in any order.  Children must be up to date.
+static void aabbRotate(AABBTree *t, int a) {
+	TreeNode *A = &t->nodes[a];
+	if (A->height < 2) return;
+
+	int b = A->child[0], c = A->child[1];
+	float areaB = aabbNodeArea(t, b), areaC = aabbNodeArea(t, c);
+	float best = 0.0f;
+	int swapP = -1, swapQ = -1;
+
+	// A child and a grandchild: the child's sibling is left with the grandchild's sibling.
+	for (int k = 0; k < 2; k++) {
+		int x = A->child[k], y = A->child[1 - k];
+		const TreeNode *Y = &t->nodes[y];
+		if (Y->height == 0) continue;
+		for (int j = 0; j < 2; j++) {
+			float gain = aabbPairArea(t, x, Y->child[1 - j]) - (k == 0 ? areaC : areaB);
+			if (gain < best) {
+				best = gain;
+				swapP = x;
+				swapQ = Y->child[j];
+			}
+		}
+	}
+
+	// A grandchild on each side.
+	if (t->nodes[b].height > 0 && t->nodes[c].height > 0) {
+		const TreeNode *B = &t->nodes[b], *C = &t->nodes[c];
+		for (int i = 0; i < 2; i++) {
+			for (int j = 0; j < 2; j++) {
+				float gain = aabbPairArea(t, C->child[j], B->child[1 - i])
+						+ aabbPairArea(t, B->child[i], C->child[1 - j]) - areaB - areaC;
+				if (gain < best) {
+					best = gain;
+					swapP = B->child[i];
+					swapQ = C->child[j];
+				}
+			}
+		}
+	}
+	if (swapP < 0) return;
+
+	aabbSwapNodes(t, swapP, swapQ);
+	if (t->nodes[b].height > 0) aabbRefitNode(t, b);
+	if (t->nodes[c].height > 0) aabbRefitNode(t, c);
+}
+
+// Refit, rebalance and rotate every node from n up to the root.
+static void aabbFixUpwards(AABBTree *t, int n) {
+	while (n >= 0) {
+		n = aabbBalance(t, n);
+		aabbRotate(t, n);
+		aabbRefitNode(t, n);
+		n = t->nodes[n].parent;
+	}
+}
+
+static void aabbInsertLeaf(AABBTree *t, int leaf) {
+	if (t->root < 0) {
+		t->root = leaf;
+		t->nodes[leaf].parent = -1;
+		return;
+	}
+
+	// Walk down to the sibling that adds the least area.  Making a new parent here costs
+	// the area of the combined box, and every ancestor grows by its own increase.
+	const float *lo = t->nodes[leaf].boxMin, *hi = t->nodes[leaf].boxMax;
+	int n = t->root;
+	while (t->nodes[n].height > 0) {
+		const TreeNode *node = &t->nodes[n];
+		float area = aabbArea(node->boxMin, node->boxMax);
+		float combined = aabbUnionArea(node, lo, hi);
+		float here = 2.0f * combined;
+		float inherited = 2.0f * (combined - area);
+
+		float cost[2];
+		for (int k = 0; k < 2; k++) {
+			const TreeNode *child = &t->nodes[node->child[k]];
+			cost[k] = aabbUnionArea(child, lo, hi) + inherited;
+			if (child->height > 0) {
+				cost[k] -= aabbArea(child->boxMin, child->boxMax);
+			}
+		}
+		if (here < cost[0] && here < cost[1]) break;
+		n = node->child[cost[1] < cost[0] ? 1 : 0];
+	}
+
+	// A new parent for the leaf and its sibling, in the sibling's place.
+	int parent = aabbAllocNode(t);
+	int oldParent = t->nodes[n].parent;
+	t->nodes[parent].parent = oldParent;
+	t->nodes[parent].child[0] = n;
+	t->nodes[parent].child[1] = leaf;
+	t->nodes[n].parent = parent;
+	t->nodes[leaf].parent = parent;
+	if (oldParent < 0) {
+		t->root = parent;
+	} else {
+		TreeNode *P = &t->nodes[oldParent];
+		P->child[P->child[0] == n ? 0 : 1] = parent;
+	}
+	aabbFixUpwards(t, parent);
+}
+
+static void aabbRemoveLeaf(AABBTree *t, int leaf) {
+	if (leaf == t->root) {
+		t->root = -1;
+		return;
+	}
+
+	// The leaf's sibling takes its parent's place.
+	int parent = t->nodes[leaf].parent;
+	int grandparent = t->nodes[parent].parent;
+	int sibling = t->nodes[parent].child[t->nodes[parent].child[0] == leaf ? 1 : 0];
+	t->nodes[sibling].parent = grandparent;
+	aabbFreeNode(t, parent);
+	if (grandparent < 0) {
+		t->root = sibling;
+	} else {
+		TreeNode *G = &t->nodes[grandparent];
+		G->child[G->child[0] == parent ? 0 : 1] = sibling;
+		aabbFixUpwards(t, grandparent);
+	}
+}
+
+// The margin a leaf's box is enlarged by: a tenth of its largest side, and a little more
+// so points and flat boxes get some too.
+static inline float aabbMargin(const vec3 &lo, const vec3 &hi) {
+	return 0.01f + 0.1f * max(hi[0] - lo[0], max(hi[1] - lo[1], hi[2] - lo[2]));
+}
+
+static void aabbSetFatBox(TreeNode *leaf, const vec3 &lo, const vec3 &hi) {
+	float m = aabbMargin(lo, hi);
+	for (int c = 0; c < 3; c++) {
+		leaf->boxMin[c] = lo[c] - m;
+		leaf->boxMax[c] = hi[c] + m;
+	}
+}
+
+// Add an item with a box, returning its leaf.
+int aabbInsert(AABBTree *t, int item, const vec3 &lo, const vec3 &hi) {
+	int leaf = aabbAllocNode(t);
+	t->nodes[leaf].item = item;
+	aabbSetFatBox(&t->nodes[leaf], lo, hi);
+	aabbInsertLeaf(t, leaf);
+	t->nLeaves++;
+	return leaf;
+}
+
+void aabbRemove(AABBTree *t, int leaf) {
+	aabbRemoveLeaf(t, leaf);
+	aabbFreeNode(t, leaf);
+	t->nLeaves--;
+}
+
+// Give a leaf's item a new box.  The tree only changes if the box has left the leaf's fat
+// box, or shrunk well inside it; then the leaf is reinserted, and this returns true.
+bool aabbMove(AABBTree *t, int leaf, const vec3 &lo, const vec3 &hi) {
+	TreeNode *node = &t->nodes[leaf];
+	float slack = 4.0f * aabbMargin(lo, hi);
+	bool fits = true;
+	for (int c = 0; c < 3 && fits; c++) {
+		fits = lo[c] >= node->boxMin[c] && hi[c] <= node->boxMax[c]
+				&& lo[c] - node->boxMin[c] <= slack && node->boxMax[c] - hi[c] <= slack;
+	}
+	if (fits) return false;
+
+	aabbRemoveLeaf(t, leaf);
+	aabbSetFatBox(&t->nodes[leaf], lo, hi);
+	aabbInsertLeaf(t, leaf);
+	t->reinserts++;
+	return true;
+}
+
+// ---- [Queries] --------------------------------------------------------------
+
+// Call visit for every item in a subtree.
+static void aabbVisitAll(const AABBTree *t, int n, void (*visit)(void *context, int item), void *context) {
+	int stack[aabbStackSize];
+	int top = 0;
+	stack[top++] = n;
+	while (top > 0) {
+		const TreeNode *node = &t->nodes[stack[--top]];
+		if (node->height == 0) {
+			visit(context, node->item);
+		} else {
+			stack[top++] = node->child[0];
+			stack[top++] = node->child[1];
+		}
+	}
+}
+
+// Find the items whose boxes are inside or cross a frustum (with planes in world
+// coordinates).  Subtrees entirely inside are visited without further tests, with
+// visitInside; leaves that cross a plane are passed to visitCrossing.
+void aabbQueryFrustum(const AABBTree *t, const FrustumPlanes *f, void (*visitInside)(void *context, int item),
+		void (*visitCrossing)(void *context, int item), void *context) {
+	if (t->root < 0) return;
+	int stack[aabbStackSize];
+	int top = 0;
+	stack[top++] = t->root;
+	while (top > 0) {
+		int n = stack[--top];
+		const TreeNode *node = &t->nodes[n];
+
+		// Test the box corner furthest along each plane's normal (if it's outside, so is the
+		// box) and the nearest (if it's inside, so is the box).
+		bool outside = false, inside = true;
+		for (int p = 0; p < 6 && !outside; p++) {
+			const float *pl = f->plane[p];
+			float far = pl[3], near = pl[3];
+			for (int c = 0; c < 3; c++) {
+				far += pl[c] * (pl[c] > 0.0f ? node->boxMax[c] : node->boxMin[c]);
+				near += pl[c] * (pl[c] > 0.0f ? node->boxMin[c] : node->boxMax[c]);
+			}
+			outside = far < 0.0f;
+			inside = inside && near >= 0.0f;
+		}
+		if (outside) continue;
+
+		if (inside) {
+			aabbVisitAll(t, n, visitInside, context);
+		} else if (node->height == 0) {
+			visitCrossing(context, node->item);
+		} else {
+			stack[top++] = node->child[0];
+			stack[top++] = node->child[1];
+		}
+	}
+}
+
+// True if accept returns true for any item whose box touches a sphere.  Stops at the first.
+bool aabbAnyInSphere(const AABBTree *t, const vec3 &centre, float radius,
+		bool (*accept)(void *context, int item), void *context) {
+	if (t->root < 0) return false;
+	int stack[aabbStackSize];
+	int top = 0;
+	stack[top++] = t->root;
+	while (top > 0) {
+		const TreeNode *node = &t->nodes[stack[--top]];
+		float dist2 = 0.0f;
+		for (int c = 0; c < 3; c++) {
+			float e = max(max(node->boxMin[c] - centre[c], centre[c] - node->boxMax[c]), 0.0f);
+			dist2 += e * e;
+		}
+		if (dist2 > radius * radius) continue;
+
+		if (node->height > 0) {
+			stack[top++] = node->child[0];
+			stack[top++] = node->child[1];
+		} else if (accept(context, node->item)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Find the nearest item a ray hits before tMax, as bvhRayCast does (see picking.h).
+int aabbRayCast(const AABBTree *t, const Ray &ray, float *tMax,
+		float (*hitItem)(void *context, int item, const Ray &ray, float tMax), void *context) {
+	int nearest = -1;
+	if (t->root < 0) return nearest;
+	int stack[aabbStackSize];
+	int top = 0;
+	stack[top++] = t->root;
+	while (top > 0) {
+		const TreeNode *node = &t->nodes[stack[--top]];
+		if (rayBoxEntry(ray, vec3(node->boxMin[0], node->boxMin[1], node->boxMin[2]),
+				vec3(node->boxMax[0], node->boxMax[1], node->boxMax[2]), *tMax) >= *tMax) {
+			continue;
+		}
+		if (node->height == 0) {
+			float hit = hitItem(context, node->item, ray, *tMax);
+			if (hit < *tMax) {
+				*tMax = hit;
+				nearest = node->item;
+			}
+			continue;
+		}
+
+		// Visit the child the ray enters first first.
+		int a = node->child[0], b = node->child[1];
+		const TreeNode *A = &t->nodes[a], *B = &t->nodes[b];
+		float ta = rayBoxEntry(ray, vec3(A->boxMin[0], A->boxMin[1], A->boxMin[2]),
+				vec3(A->boxMax[0], A->boxMax[1], A->boxMax[2]), *tMax);
+		float tb = rayBoxEntry(ray, vec3(B->boxMin[0], B->boxMin[1], B->boxMin[2]),
+				vec3(B->boxMax[0], B->boxMax[1], B->boxMax[2]), *tMax);
+		if (tb < ta) {
+			int n = a; a = b; b = n;
+			float tt = ta; ta = tb; tb = tt;
+		}
+		if (tb < *tMax) stack[top++] = b;
+		if (ta < *tMax) stack[top++] = a;
+	}
+	return nearest;
+}
+
+// ---- [Frustum culling] ------------------------------------------------------
+
+// Move eye space frustum planes into world coordinates, through a view matrix with no
+// scaling (so the planes stay normalised).
+void frustumToWorld(FrustumPlanes *world, const FrustumPlanes *eye, const mat4 &view) {
+	for (int p = 0; p < 6; p++) {
+		for (int c = 0; c < 4; c++) {
+			world->plane[p][c] = eye->plane[p][0] * view[0][c] + eye->plane[p][1] * view[1][c]
+					+ eye->plane[p][2] * view[2][c] + (c == 3 ? eye->plane[p][3] : 0.0f);
+		}
+	}
+}
+
+// The context of both is the CullSpheres.
+static void cullVisitInside(void *context, int item) {
+	((CullSpheres*) context)->visible[item] = 1;
+}
+
+static void cullVisitCrossing(void *context, int item) {
+	CullSpheres *s = (CullSpheres*) context;
+	s->pending[s->nPending++] = item;
+}
+
+// Set visible[i] for each object whose bounding sphere is at least partly in the frustum,
+// with the tree deciding which spheres need testing, then testing them together (see
+// testPendingSpheres).  Returns how many are culled.
+int cullSpheresWithTree(const AABBTree *t, const FrustumPlanes *eyeFrustum, const mat4 &view, CullSpheres *s) {
+	memset(s->visible, 0, s->count);
+	FrustumPlanes world;
+	frustumToWorld(&world, eyeFrustum, view);
+	aabbQueryFrustum(t, &world, cullVisitInside, cullVisitCrossing, s);
+	testPendingSpheres(eyeFrustum, s);
+
+	int culled = 0;
+	for (int i = 0; i < s->count; i++) {
+		culled += !s->visible[i];
+	}
+	return culled;
+}
+
+// ---- [Benchmark] ------------------------------------------------------------
+
+// --bench-tree: random boxes in a cube that grows with their number (so each query finds
+// about as many), from 1K to 1M of them.  Times building the tree by inserting, moving
+// every box a little, and frustum, sphere and ray queries, against linear scans of every
+// box.  Prints a table and exits.
+
+typedef struct {
+	vec3 *boxMin, *boxMax;  // Tight boxes
+	const FrustumPlanes *frustum;
+	vec3 centre;
+	float radius;
+	int found;
+} TreeBench;
+
+static unsigned int treeBenchSeed = 1;
+
+static float treeBenchRandom() {  // 0 to 1
+	treeBenchSeed = treeBenchSeed * 1664525u + 1013904223u;
+	return (treeBenchSeed >> 8) * (1.0f / 16777216.0f);
+}
+
+static bool boxInFrustum(const FrustumPlanes *f, const vec3 &lo, const vec3 &hi) {
+	for (int p = 0; p < 6; p++) {
+		const float *pl = f->plane[p];
+		float far = pl[3];
+		for (int c = 0; c < 3; c++) {
+			far += pl[c] * (pl[c] > 0.0f ? hi[c] : lo[c]);
+		}
+		if (far < 0.0f) return false;
+	}
+	return true;
+}
+
+static bool boxInSphere(const vec3 &lo, const vec3 &hi, const vec3 &centre, float radius) {
+	float dist2 = 0.0f;
+	for (int c = 0; c < 3; c++) {
+		float e = max(max(lo[c] - centre[c], centre[c] - hi[c]), 0.0f);
+		dist2 += e * e;
+	}
+	return dist2 <= radius * radius;
+}
+
+static void benchVisitInside(void *context, int item) {
+	((TreeBench*) context)->found++;
+}
+
+static void benchVisitCrossing(void *context, int item) {
+	TreeBench *b = (TreeBench*) context;
+	b->found += boxInFrustum(b->frustum, b->boxMin[item], b->boxMax[item]);
+}
+
+static bool benchAcceptSphere(void *context, int item) {
+	TreeBench *b = (TreeBench*) context;
+	b->found += boxInSphere(b->boxMin[item], b->boxMax[item], b->centre, b->radius);
+	return false;  // Count them all
+}
+
+static float benchHitBox(void *context, int item, const Ray &ray, float tMax) {
+	TreeBench *b = (TreeBench*) context;
+	return rayBoxEntry(ray, b->boxMin[item], b->boxMax[item], tMax);
+}
+
+void benchAABBTree() {
+	const int sizes[] = { 1000, 10000, 100000, 1000000 };
+	const int nQueries = 1000;
+
+	printf("AABB tree with random boxes: microseconds per box, or per query, with linear scans in brackets\n");
+	printf("%8s %7s %7s %9s %6s %18s %18s %18s\n", "Boxes", "Insert", "Move", "Reinsert", "Height",
+			"Frustum", "Sphere", "Ray");
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		int n = sizes[s];
+		float side = 10.0f * cbrt((float) n);
+		TreeBench b;
+		b.boxMin = new vec3[n];
+		b.boxMax = new vec3[n];
+		int *leaves = new int[n];
+		AABBTree tree = { NULL, 0, -1, -1, 0, 0 };
+
+		double start = clockSeconds();
+		for (int i = 0; i < n; i++) {
+			vec3 size(0.5f + treeBenchRandom(), 0.5f + treeBenchRandom(), 0.5f + treeBenchRandom());
+			b.boxMin[i] = vec3(side * treeBenchRandom(), side * treeBenchRandom(), side * treeBenchRandom());
+			b.boxMax[i] = b.boxMin[i] + size;
+			leaves[i] = aabbInsert(&tree, i, b.boxMin[i], b.boxMax[i]);
+		}
+		double insertSeconds = clockSeconds() - start;
+
+		// A step of up to 0.1 in each direction, about as far as a walking object goes in
+		// a frame.
+		start = clockSeconds();
+		for (int i = 0; i < n; i++) {
+			vec3 step(0.2f * treeBenchRandom() - 0.1f, 0.2f * treeBenchRandom() - 0.1f, 0.2f * treeBenchRandom() - 0.1f);
+			b.boxMin[i] += step;
+			b.boxMax[i] += step;
+			aabbMove(&tree, leaves[i], b.boxMin[i], b.boxMax[i]);
+		}
+		double moveSeconds = clockSeconds() - start;
+
+		// A 60 degree frustum from the middle of the cube, reaching a quarter of the way out.
+		mat4 view = RotateY(30.0) * Translate(-0.5f * side, -0.5f * side, -0.5f * side);
+		FrustumPlanes eye, world;
+		extractFrustumPlanes(&eye, Perspective(60.0, 1.0, 0.1, 0.25f * side));
+		frustumToWorld(&world, &eye, view);
+		b.frustum = &world;
+
+		b.found = 0;
+		start = clockSeconds();
+		aabbQueryFrustum(&tree, &world, benchVisitInside, benchVisitCrossing, &b);
+		double frustumTree = clockSeconds() - start;
+		int treeFound = b.found;
+		start = clockSeconds();
+		b.found = 0;
+		for (int i = 0; i < n; i++) {
+			b.found += boxInFrustum(&world, b.boxMin[i], b.boxMax[i]);
+		}
+		double frustumLinear = clockSeconds() - start;
+		int mismatches = treeFound != b.found;
+
+		// Sphere and ray queries from random points.  The linear scans do fewer, as they
+		// take much longer with many boxes.
+		int nLinear = max(10, min(nQueries, 10000000 / n));
+		double sphereTree = 0.0, sphereLinear = 0.0, rayTree = 0.0, rayLinear = 0.0;
+		for (int q = 0; q < nQueries; q++) {
+			b.centre = vec3(side * treeBenchRandom(), side * treeBenchRandom(), side * treeBenchRandom());
+			b.radius = 2.0f;
+			vec3 dir(treeBenchRandom() - 0.5f, treeBenchRandom() - 0.5f, treeBenchRandom() - 0.5f);
+			Ray ray = makeRay(b.centre, normalize(dir) * side);  // t is 0 to 1 across the cube
+
+			b.found = 0;
+			start = clockSeconds();
+			aabbAnyInSphere(&tree, b.centre, b.radius, benchAcceptSphere, &b);
+			sphereTree += clockSeconds() - start;
+			treeFound = b.found;
+
+			float tTree = 1.0f;
+			start = clockSeconds();
+			aabbRayCast(&tree, ray, &tTree, benchHitBox, &b);
+			rayTree += clockSeconds() - start;
+
+			if (q >= nLinear) continue;
+			start = clockSeconds();
+			b.found = 0;
+			for (int i = 0; i < n; i++) {
+				b.found += boxInSphere(b.boxMin[i], b.boxMax[i], b.centre, b.radius);
+			}
+			sphereLinear += clockSeconds() - start;
+
+			start = clockSeconds();
+			float tLinear = 1.0f;
+			for (int i = 0; i < n; i++) {
+				tLinear = min(tLinear, rayBoxEntry(ray, b.boxMin[i], b.boxMax[i], tLinear));
+			}
+			rayLinear += clockSeconds() - start;
+			mismatches += treeFound != b.found || tTree != tLinear;
+		}
+
+		char frustumCol[32], sphereCol[32], rayCol[32];
+		snprintf(frustumCol, sizeof(frustumCol), "%.1f (%.1f)", frustumTree * 1e6, frustumLinear * 1e6);
+		snprintf(sphereCol, sizeof(sphereCol), "%.2f (%.1f)", sphereTree * 1e6 / nQueries, sphereLinear * 1e6 / nLinear);
+		snprintf(rayCol, sizeof(rayCol), "%.2f (%.1f)", rayTree * 1e6 / nQueries, rayLinear * 1e6 / nLinear);
+		printf("%8d %7.3f %7.3f %8.1f%% %6d %18s %18s %18s\n", n, insertSeconds * 1e6 / n, moveSeconds * 1e6 / n,
+				100.0 * tree.reinserts / n, tree.nodes[tree.root].height, frustumCol, sphereCol, rayCol);
+		if (mismatches > 0) {
+			printf("  %d queries found different boxes to the linear scan\n", mismatches);
+		}
+
+		free(tree.nodes);
+		delete[] b.boxMin;
+		delete[] b.boxMax;
+		delete[] leaves;
+	}
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,89 @@
+// Bone palettes for meshes with bones, streamed through a buffer texture (bonepalette.h)
+
+// Each frame the pose of every object with bones that's drawn is calculated once, and its
+// bone matrices (its palette) are written one after another into bonePaletteRing, in the
+// column-major layout GLSL reads, so no transpose is needed.  The ring is attached to a
+// buffer texture of RGBA32F texels, a matrix being four texels (its columns).  Each
+// object's ObjectData holds the index of its palette's first matrix (see instancing.h),
+// so the vertex shader fetches its bones with texelFetch.  With no bone uniforms to set
+// between draws, objects with bones are batched and grouped like any others.
+//
+// Objects of the same mesh at the same point in its animation (e.g. a crowd started
+// together) share one palette.  The render queue keeps objects of a mesh together, so
+// remembering the latest palette of each mesh finds most of them.
+
+const int bonePaletteUnit = 4;  // After the light units (see lights.h)
+const GLsizeiptr paletteMatrixSize = sizeof(GLfloat) * 16;
+
+typedef struct {
+	int frame;  // The frame the palette was written in
+	float poseTime;
+	GLint first;  // The index of its first matrix
+} PaletteCache;
+
+StreamBuffer bonePaletteRing;
+GLuint bonePaletteTexture;
+GLuint bonePaletteBuffer = 0;  // The buffer the texture is attached to
+GLint maxPaletteTexels;  // GL_MAX_TEXTURE_BUFFER_SIZE
+PaletteCache paletteCache[numMeshes];  // The latest palette of each mesh
+int paletteFrame = 0;
+
+void initBonePalettes() {
+	// Room for 256 matrices per frame to start with; it grows as needed.
+	streamInit(&bonePaletteRing, GL_TEXTURE_BUFFER, 256 * paletteMatrixSize, 0);
+	glGenTextures(1, &bonePaletteTexture); CheckError();
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxPaletteTexels); CheckError();
+}
+
+// Start writing a frame's palettes, which take at most bytesNeeded.
+void beginBonePalettes(GLsizeiptr bytesNeeded) {
+	paletteFrame++;
+	streamBegin(&bonePaletteRing, bytesNeeded);
+	if (bonePaletteRing.regionSize * streamRegions / 16 > maxPaletteTexels) {
+		failInt("Error - bone palettes don't fit in a buffer texture, texels:",
+				(int) (bonePaletteRing.regionSize * streamRegions / 16));
+	}
+
+	// Growing the ring replaces its buffer, so the texture is attached again.
+	if (bonePaletteRing.buffer != bonePaletteBuffer) {
+		glActiveTexture(GL_TEXTURE0 + bonePaletteUnit); CheckError();
+		glBindTexture(GL_TEXTURE_BUFFER, bonePaletteTexture); CheckError();
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, bonePaletteRing.buffer); CheckError();
+		glActiveTexture(GL_TEXTURE0); CheckError();
+		bonePaletteBuffer = bonePaletteRing.buffer;
+	}
+}
+
+// Write the palette of a mesh posed at poseTime (in the first animation), unless it was
+// already written this frame, returning the index of its first matrix.  The palette is
+// built locally then copied into the mapped buffer.
+GLint addBonePalette(int meshId, aiMesh *mesh, const aiScene *scene, float poseTime) {
+	PaletteCache *cache = &paletteCache[meshId];
+	if (cache->frame == paletteFrame && cache->poseTime == poseTime) {
+		frameStats.palettesShared++;
+		return cache->first;
+	}
+
+	int nBones = mesh->mNumBones;
+	mat4 boneTransforms[nBones];
+	GLfloat palette[nBones][16];
+	calculateAnimPose(mesh, scene, 0, poseTime, boneTransforms);
+	for (int b = 0; b < nBones; b++) {
+		storeMatrix(palette[b], boneTransforms[b]);
+	}
+
+	void *dst;
+	GLintptr offset = streamAlloc(&bonePaletteRing, paletteMatrixSize * nBones, paletteMatrixSize, &dst);
+	memcpy(dst, palette, paletteMatrixSize * nBones);
+
+	cache->frame = paletteFrame;
+	cache->poseTime = poseTime;
+	cache->first = offset / paletteMatrixSize;
+	frameStats.bonePalettes++;
+	return cache->first;
+}
+
+// Finish writing the frame's palettes (before any draws that read them).
+void endBonePalettes() {
+	streamEndWrites(&bonePaletteRing);
+}
@@ -0,0 +1,6 @@
+#version 150
+
+// Colour writes are off while boxes are drawn, so there's nothing to output.
+
+void main() {
+}
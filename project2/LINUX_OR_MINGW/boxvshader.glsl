@@ -0,0 +1,11 @@
+#version 150
+
+// Draws bounding boxes for occlusion queries (see occlusion.h)
+
+in vec4 vPosition;  // A corner of the unit cube
+
+uniform mat4 BoxTransform;  // Unit cube to clip coordinates
+
+void main() {
+	gl_Position = BoxTransform * vPosition;
+}
@@ -0,0 +1,172 @@
+// Bounding volumes and view-frustum culling (culling.h)
+
+// Each mesh gets an axis-aligned box and a bounding sphere when it's loaded.  Each frame
+// every object's sphere is moved into eye coordinates and stored structure-of-arrays
+// style (all x's together, then y's, ...).  The object tree (see aabbtree.h) marks the
+// objects in subtrees wholly inside the frustum as visible, and lists those in subtrees
+// crossing its planes, whose spheres are then tested four at a time with SSE.
+
+#ifdef __SSE__
+#  include <xmmintrin.h>
+#endif
+
+typedef struct {
+	vec3 boxMin, boxMax;  // Axis-aligned bounding box, in model coordinates.
+	vec3 centre;  // Bounding sphere.
+	float radius;
+} MeshBounds;
+
+// Grow bounds to include a set of points.  Call resetBounds first.
+void resetBounds(MeshBounds *b) {
+	b->boxMin = vec3(1e30f, 1e30f, 1e30f);
+	b->boxMax = vec3(-1e30f, -1e30f, -1e30f);
+	b->centre = vec3(0.0, 0.0, 0.0);
+	b->radius = 0.0f;
+}
+
+void addBoundsPoint(MeshBounds *b, const vec3 &p) {
+	for (int c = 0; c < 3; c++) {
+		b->boxMin[c] = min(b->boxMin[c], p[c]);
+		b->boxMax[c] = max(b->boxMax[c], p[c]);
+	}
+}
+
+// Centre the sphere on the box, with a radius that contains the box.  (This is looser
+// than the tightest sphere for the points, but also covers them after interpolation.)
+void finishBounds(MeshBounds *b) {
+	b->centre = (b->boxMin + b->boxMax) * 0.5;
+	b->radius = length(b->boxMax - b->centre);
+}
+
+// Set a mesh's bounds from its vertices.  Meshes with bones are posed at a number of points
+// through their first animation, so the bounds cover every pose, not just the rest pose.
+const int boundsPoseSamples = 16;
+
+void computeMeshBounds(MeshBounds *b, aiMesh *mesh, const aiScene *scene,
+		GLint boneIDs[][4], GLfloat boneWeights[][4]) {
+	resetBounds(b);
+	for (unsigned int v = 0; v < mesh->mNumVertices; v++) {
+		const aiVector3D &p = mesh->mVertices[v];
+		addBoundsPoint(b, vec3(p.x, p.y, p.z));
+	}
+
+	if (mesh->mNumBones > 0 && scene->mNumAnimations > 0) {
+		double animDuration = getAnimDuration(mesh, scene, 0);
+		mat4 boneTransforms[mesh->mNumBones];
+		for (int sample = 0; sample < boundsPoseSamples; sample++) {
+			calculateAnimPose(mesh, scene, 0, animDuration * sample / boundsPoseSamples, boneTransforms);
+			for (unsigned int v = 0; v < mesh->mNumVertices; v++) {
+				const aiVector3D &p = mesh->mVertices[v];
+				vec4 rest(p.x, p.y, p.z, 1.0), posed(0.0, 0.0, 0.0, 0.0);
+				for (int k = 0; k < 4; k++) {
+					posed += boneWeights[v][k] * (boneTransforms[boneIDs[v][k]] * rest);
+				}
+				addBoundsPoint(b, vec3(posed.x, posed.y, posed.z));
+			}
+		}
+	}
+	finishBounds(b);
+}
+
+// ---- [Frustum] --------------------------------------------------------------
+
+// Planes are stored as (a, b, c, d) with a*x + b*y + c*z + d >= 0 on the inside,
+// in eye coordinates, normalised so that a*x + b*y + c*z + d is a distance.
+typedef struct {
+	float plane[6][4];
+} FrustumPlanes;
+
+// Extract the left, right, bottom, top, near and far planes of a projection matrix.
+void extractFrustumPlanes(FrustumPlanes *f, const mat4 &proj) {
+	for (int p = 0; p < 6; p++) {
+		int row = p / 2;
+		float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+		for (int c = 0; c < 4; c++) {
+			f->plane[p][c] = proj[3][c] + sign * proj[row][c];
+		}
+		float len = sqrt(f->plane[p][0] * f->plane[p][0] + f->plane[p][1] * f->plane[p][1]
+				+ f->plane[p][2] * f->plane[p][2]);
+		for (int c = 0; c < 4; c++) {
+			f->plane[p][c] /= len;
+		}
+	}
+}
+
+// ---- [Sphere culling] -------------------------------------------------------
+
+// Bounding spheres in eye coordinates, and the result of culling them.
+typedef struct {
+	float *x, *y, *z, *r;
+	unsigned char *visible;
+	int *pending;  // Spheres still to be tested, nPending of them
+	int count, capacity, nPending;
+} CullSpheres;
+
+void resizeCullSpheres(CullSpheres *s, int count) {
+	if (count > s->capacity) {
+		s->capacity = max(256, (count + 3) & ~3);
+		s->x = (float*) realloc(s->x, sizeof(float) * s->capacity);
+		s->y = (float*) realloc(s->y, sizeof(float) * s->capacity);
+		s->z = (float*) realloc(s->z, sizeof(float) * s->capacity);
+		s->r = (float*) realloc(s->r, sizeof(float) * s->capacity);
+		s->visible = (unsigned char*) realloc(s->visible, s->capacity);
+		s->pending = (int*) realloc(s->pending, sizeof(int) * s->capacity);
+		if (s->x == NULL || s->y == NULL || s->z == NULL || s->r == NULL || s->visible == NULL
+				|| s->pending == NULL) {
+			failInt("Error - out of memory for culling spheres:", s->capacity);
+		}
+	}
+	s->count = count;
+	s->nPending = 0;
+}
+
+void setCullSphere(CullSpheres *s, int i, const vec4 &centre, float radius) {
+	s->x[i] = centre.x;
+	s->y[i] = centre.y;
+	s->z[i] = centre.z;
+	s->r[i] = radius;
+}
+
+// True if sphere i is at least partly inside the frustum.
+inline bool sphereInFrustum(const FrustumPlanes *f, const CullSpheres *s, int i) {
+	for (int p = 0; p < 6; p++) {
+		const float *pl = f->plane[p];
+		if (pl[0] * s->x[i] + pl[1] * s->y[i] + pl[2] * s->z[i] + pl[3] < -s->r[i]) return false;
+	}
+	return true;
+}
+
+// Set visible[i] for each pending sphere that's at least partly inside the frustum, and
+// empty the pending list.
+void testPendingSpheres(const FrustumPlanes *f, CullSpheres *s) {
+	const int *items = s->pending;
+	int k = 0;
+
+#ifdef __SSE__
+	for (; k + 4 <= s->nPending; k += 4) {
+		const int *it = &items[k];
+		__m128 x = _mm_setr_ps(s->x[it[0]], s->x[it[1]], s->x[it[2]], s->x[it[3]]);
+		__m128 y = _mm_setr_ps(s->y[it[0]], s->y[it[1]], s->y[it[2]], s->y[it[3]]);
+		__m128 z = _mm_setr_ps(s->z[it[0]], s->z[it[1]], s->z[it[2]], s->z[it[3]]);
+		__m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_setr_ps(s->r[it[0]], s->r[it[1]], s->r[it[2]], s->r[it[3]]));
+
+		__m128 inside = _mm_cmpeq_ps(x, x);  // All ones (x is never NaN), without needing SSE2
+		for (int p = 0; p < 6; p++) {
+			const float *pl = f->plane[p];
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(pl[0])), _mm_mul_ps(y, _mm_set1_ps(pl[1]))),
+					_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(pl[2])), _mm_set1_ps(pl[3])));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int j = 0; j < 4; j++) {
+			s->visible[it[j]] = (mask >> j) & 1;
+		}
+	}
+#endif
+
+	for (; k < s->nPending; k++) {
+		s->visible[items[k]] = sphereInFrustum(f, s, items[k]);
+	}
+	s->nPending = 0;
+}
@@ -0,0 +1,14 @@
+#version 150
+
+// For the depth pre-pass only depth is needed, so there's nothing to output (see
+// depthprepass.h).  With OVERDRAW, each fragment adds an eighth of white instead.
+
+#ifdef OVERDRAW
+out vec4 fColor;
+#endif
+
+void main() {
+#ifdef OVERDRAW
+	fColor = vec4(0.125, 0.125, 0.125, 1.0);
+#endif
+}
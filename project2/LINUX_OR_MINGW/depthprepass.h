@@ -0,0 +1,70 @@
+// Depth pre-pass and the overdraw view (depthprepass.h)
+
+// With the pre-pass on (the 'z' key, or --depth-prepass on the command line) the main
+// groups are drawn twice.  The first pass uses depth-only shader variants and draws the
+// groups nearest first, filling in the depth buffer with colour writes off.  The second
+// uses the full shaders with the depth test set to GL_EQUAL and depth writes off, so each
+// pixel runs the lighting for just the one fragment that ends up in it.  Both passes use
+// the same vertex shader, with gl_Position declared invariant, so their depths match
+// exactly.
+//
+// Without the pre-pass the main groups themselves are drawn nearest first, so nearer
+// objects hide more of the fragments behind them.  With it, the shading pass keeps the
+// render queue's order, which needs fewer binds.
+//
+// The overdraw view (the 'v' key, or --overdraw) replaces the lighting with a constant
+// that's added to the pixel, so a pixel's brightness shows how many fragments were shaded
+// for it: each adds an eighth of white.
+
+bool depthPrepass = false;
+bool overdrawView = false;
+
+int *groupOrder = NULL;
+int groupOrderCapacity = 0;
+
+static int compareGroupDepth(const void *a, const void *b) {
+	float da = groups[*(const int*) a].nearDepth, db = groups[*(const int*) b].nearDepth;
+	return (da > db) - (da < db);
+}
+
+// The first n groups, nearest first (roughly: by each group's nearest object).
+const int *frontToBackOrder(int n) {
+	if (n > groupOrderCapacity) {
+		groupOrderCapacity = max(64, n * 2);
+		groupOrder = (int*) realloc(groupOrder, sizeof(int) * groupOrderCapacity);
+		if (groupOrder == NULL) {
+			failInt("Error - out of memory for the group order:", groupOrderCapacity);
+		}
+	}
+	for (int g = 0; g < n; g++) {
+		groupOrder[g] = g;
+	}
+	qsort(groupOrder, n, sizeof(int), compareGroupDepth);
+	return groupOrder;
+}
+
+void beginDepthPrepass() {
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE); CheckError();
+}
+
+// Shade only the fragments the pre-pass left in the depth buffer.
+void beginShadingPass() {
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE); CheckError();
+	glDepthMask(GL_FALSE); CheckError();
+	glDepthFunc(GL_EQUAL); CheckError();
+}
+
+void endShadingPass() {
+	glDepthMask(GL_TRUE); CheckError();
+	glDepthFunc(GL_LESS); CheckError();
+}
+
+// Add up the fragments drawn for each pixel.
+void beginOverdraw() {
+	glEnable(GL_BLEND); CheckError();
+	glBlendFunc(GL_ONE, GL_ONE); CheckError();
+}
+
+void endOverdraw() {
+	glDisable(GL_BLEND); CheckError();
+}
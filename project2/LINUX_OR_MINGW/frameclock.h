@@ -0,0 +1,74 @@
+// Frame and simulation clocks (frameclock.h)
+
+// A single high resolution monotonic clock is sampled once at the start of each frame,
+// so every object in the frame sees the same time.  Animation and motion are advanced
+// on a separate simulation clock in fixed steps of simStep seconds, and rendering
+// interpolates between the last two simulation steps using simAlpha.
+//
+// In fixed dt mode each frame advances the simulation by exactly one step regardless of
+// how long the frame took, so runs (and benchmarks) are reproducible.
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
+
+const double simStep = 1.0 / 120.0;  // Length of one simulation step, in seconds.
+const int maxSimStepsPerFrame = 8;  // Drop time rather than spiral after a long stall.
+
+bool fixedDtMode = false;  // Set by --fixed-dt on the command line.
+
+double frameStartTime = 0.0;  // Clock reading at the start of the current frame.
+double frameDeltaTime = 0.0;  // Wall time since the start of the previous frame.
+double simTime = 0.0;  // Time of the latest simulation step.
+double simAccumulator = 0.0;  // Wall time not yet consumed by simulation steps.
+float simAlpha = 0.0f;  // How far rendering is between the previous and latest step.
+
+// Seconds from a monotonic high resolution clock (the origin is arbitrary).
+double clockSeconds() {
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (double) now.QuadPart / (double) freq.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+void initFrameClock() {
+	frameStartTime = clockSeconds();
+	frameDeltaTime = 0.0;
+	simTime = 0.0;
+	simAccumulator = 0.0;
+	simAlpha = fixedDtMode ? 1.0f : 0.0f;
+}
+
+// Sample the clock for a new frame, and return how many simulation steps to run.
+// The caller should advance the simulation by simStep that many times.
+int beginFrameClock() {
+	double now = clockSeconds();
+	frameDeltaTime = now - frameStartTime;
+	frameStartTime = now;
+
+	if (fixedDtMode) {
+		simAlpha = 1.0f;  // Always render exactly the latest step
+		return 1;
+	}
+
+	simAccumulator += frameDeltaTime;
+	int steps = (int) (simAccumulator / simStep);
+	if (steps > maxSimStepsPerFrame) {
+		steps = maxSimStepsPerFrame;
+		simAccumulator = steps * simStep;
+	}
+	simAccumulator -= steps * simStep;
+	simAlpha = (float) (simAccumulator / simStep);
+	return steps;
+}
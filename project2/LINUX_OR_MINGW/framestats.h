@@ -0,0 +1,66 @@
+// Per-frame rendering counters (framestats.h)
+
+// Counters are incremented into frameStats while a frame is drawn, then added to
+// statsTotals by endFrameStats.  While stats are turned on (the 's' key, or --stats
+// on the command line) the averages per frame are printed once a second.
+
+// To add a counter, add a line here: X(fieldName, "description").
+#define FRAME_STATS(X) \
+	X(drawCalls, "draw calls") \
+	X(prepassDraws, "depth pre-pass draw calls") \
+	X(instancesDrawn, "objects drawn") \
+	X(matricesRebuilt, "model matrices rebuilt") \
+	X(modelViewUpdates, "model-view matrices updated") \
+	X(objectsCulled, "objects culled by the view frustum") \
+	X(occlusionQueries, "occlusion queries issued") \
+	X(objectsOccluded, "objects skipped by occlusion culling") \
+	X(trianglesOccluded, "triangles skipped by occlusion culling") \
+	X(lightRefs, "lights in clusters (summed over clusters)") \
+	X(lightsUnseen, "lights reaching no visible object") \
+	X(lightsDropped, "lights over the governor's budget") \
+	X(detailCulled, "objects too small on screen to draw") \
+	X(treeReinserts, "objects reinserted in the AABB tree") \
+	X(bonePalettes, "bone palettes written") \
+	X(palettesShared, "bone palettes shared by objects in the same pose") \
+	X(uniformCalls, "uniform calls") \
+	X(uniformSkips, "redundant uniform calls skipped") \
+	X(programBinds, "program binds") \
+	X(vaoBinds, "VAO binds") \
+	X(textureBinds, "texture binds") \
+	X(bindsSaved, "redundant binds skipped") \
+	X(bufferRangeBinds, "uniform buffer range binds") \
+	X(fenceWaits, "waits for the GPU to free ring buffer space")
+
+typedef struct {
+#define DeclareStat(name, desc)  int name;
+	FRAME_STATS(DeclareStat)
+#undef DeclareStat
+} FrameStats;
+
+FrameStats frameStats;  // Counters for the frame being drawn.
+FrameStats statsTotals;  // Summed over the frames since the last report.
+int statsFrames = 0;
+bool showStats = false;
+
+void endFrameStats() {
+#define AddStat(name, desc)  statsTotals.name += frameStats.name;
+	FRAME_STATS(AddStat)
+#undef AddStat
+	memset(&frameStats, 0, sizeof(FrameStats));
+	statsFrames++;
+}
+
+// Print the average of each counter per frame (if stats are on), then start again.
+void reportFrameStats() {
+	if (showStats && statsFrames > 0) {
+		printf("Per frame (%d frames):", statsFrames);
+#define PrintStat(name, desc)  printf(" %.1f %s,", (double) statsTotals.name / statsFrames, desc);
+		FRAME_STATS(PrintStat)
+#undef PrintStat
+		printf("\n");
+		fflush(stdout);
+	}
+
+	memset(&statsTotals, 0, sizeof(FrameStats));
+	statsFrames = 0;
+}
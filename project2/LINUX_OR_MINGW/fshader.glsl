@@ -1,55 +1,92 @@
 #version 150
 
-in vec3 fL1, fL2;
-in vec3 fE;
+in vec3 fPos;  // In eye coordinates
 in vec3 fN;
 in vec2 texCoord;  // The third coordinate is always 0.0 and is discarded
 
 out vec4 fColor;
 
-uniform vec3 LightColor1, LightColor2;
-uniform float LightBrightness1, LightBrightness2;
-uniform vec3 AmbientProduct, DiffuseProduct, SpecularProduct;
-uniform float Shininess;
+// Data for the whole frame (FrameData in instancing.h)
+layout(std140) uniform FrameBlock {
+	mat4 Projection;
+	mat4 View;
+	vec4 ClusterScale;  // Tile width and height in pixels, then slice = log(depth) * z + w
+	ivec4 ClusterGrid;  // Tiles across and up, depth slices, and the number of global lights
+};
+
+flat in vec3 AmbientProduct, DiffuseProduct, SpecularProduct;
+flat in float Shininess;
+flat in float texScale;
 uniform sampler2D texture;
-uniform float texScale;
 
-void main() {
+// The lights (see lights.h), two texels each: the position in eye coordinates and range,
+// then the colour times the brightness, and the brightness.  The global lights come first
+// and light every fragment.  The others are found through the fragment's cluster: its
+// offset and count in lightIndices.
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterData;
+uniform usamplerBuffer lightIndices;
+
+vec3 N, E;  // Unit normal, and direction to the eye/camera
+vec3 lit, highlights;  // Summed over the lights
+
+void addLight(int light) {
+	vec4 where = texelFetch(lightData, 2 * light);
+	vec4 color = texelFetch(lightData, 2 * light + 1);
+
 	// Unit direction vectors for Blinn-Phong shading calculation
-	vec3 L1 = normalize(fL1);  // Direction to the light source
-	vec3 L2 = normalize(fL2);
-	vec3 E = normalize(fE);  // Direction to the eye/camera
-	vec3 H1 = normalize(L1 + E);  // Halfway vector
-	vec3 H2 = normalize(L2 + E);
-	vec3 N = normalize(fN);  // Normal vector
+	vec3 toLight = where.xyz - fPos;
+	vec3 L = normalize(toLight);  // Direction to the light source
+	vec3 H = normalize(L + E);  // Halfway vector
 
 	// [G] Compute terms in the illumination equation
-	vec3 ambient1 = (LightColor1 * LightBrightness1) * AmbientProduct;
-	vec3 ambient2 = (LightColor2 * LightBrightness2) * AmbientProduct;
-
-	float Kd1 = max(dot(L1, N), 0.0);
-	float Kd2 = max(dot(L2, N), 0.0);
-	vec3 diffuse1 = Kd1 * (LightColor1 * LightBrightness1) * DiffuseProduct;
-	vec3 diffuse2 = Kd2 * (LightColor2 * LightBrightness2) * DiffuseProduct;
+	vec3 ambient = color.rgb * AmbientProduct;
+	float Kd = max(dot(L, N), 0.0);
+	vec3 diffuse = Kd * color.rgb * DiffuseProduct;
 
 	// [H] Only use brightness for specular highlights
-	float Ks1 = pow(max(dot(N, H1), 0.0), Shininess);
-	float Ks2 = pow(max(dot(N, H2), 0.0), Shininess);
-	vec3 specular1 = Ks1 * LightBrightness1 * SpecularProduct;
-	vec3 specular2 = Ks2 * LightBrightness2 * SpecularProduct;
+	float Ks = pow(max(dot(N, H), 0.0), Shininess);
+	vec3 specular = Ks * color.a * SpecularProduct;
+	if (dot(L, N) < 0.0) {
+		specular = vec3(0.0, 0.0, 0.0);
+	}
 
-	if (dot(L1, N) < 0.0) {
-		specular1 = vec3(0.0, 0.0, 0.0);
+	// [F] Reduce point lights with distance, fading out completely at their range
+	float scale = 1.0;
+	if (where.w > 0.0) {
+		float len = length(toLight);
+		float fade = clamp(1.0 - pow(len / where.w, 4.0), 0.0, 1.0);
+		scale = fade * fade / (0.01 + len);
 	}
-	if (dot(L2, N) < 0.0) {
-		specular2 = vec3(0.0, 0.0, 0.0);
+	lit += scale * (ambient + diffuse);
+	highlights += scale * specular;
+}
+
+void main() {
+	N = normalize(fN);
+	E = normalize(-fPos);
+	lit = vec3(0.0, 0.0, 0.0);
+	highlights = vec3(0.0, 0.0, 0.0);
+
+	// GLOBAL_LIGHTS, when set by shadervariants.h, is the same as ClusterGrid.w
+#ifdef GLOBAL_LIGHTS
+	for (int light = 0; light < GLOBAL_LIGHTS; light++) {
+#else
+	for (int light = 0; light < ClusterGrid.w; light++) {
+#endif
+		addLight(light);
+	}
+
+	ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / ClusterScale.xy), int(log(-fPos.z) * ClusterScale.z + ClusterScale.w));
+	cluster = clamp(cluster, ivec3(0, 0, 0), ClusterGrid.xyz - 1);
+	uvec2 range = texelFetch(clusterData, (cluster.z * ClusterGrid.y + cluster.y) * ClusterGrid.x + cluster.x).xy;
+	for (uint k = 0u; k < range.y; k++) {
+		addLight(int(texelFetch(lightIndices, int(range.x + k)).r));
 	}
 
 	// globalAmbient is independent of distance from the light source
 	vec3 globalAmbient = vec3(0.1, 0.1, 0.1);
 
-	// [F] Reduce point light with distance
-	float len = 0.01 + length(fL1);
-	vec4 color = vec4(globalAmbient + ((ambient1 + diffuse1) / len) + ambient2 + diffuse2, 1.0);
-	fColor = color * texture2D(texture, texCoord * texScale) + vec4((specular1 / len) + specular2, 1.0);
+	vec4 color = vec4(globalAmbient + lit, 1.0);
+	fColor = color * texture2D(texture, texCoord * texScale) + vec4(highlights, 1.0);
 }
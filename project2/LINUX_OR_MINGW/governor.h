@@ -0,0 +1,160 @@
+// Frame-time governor (governor.h)
+
+// With the governor on (the 'g' key, or --governor MS on the command line) each frame's
+// time is compared with a budget, 16.7 ms (60 Hz) unless MS is given.  When frames run over
+// it the scene's quality is stepped down a level, and when there's plenty to spare it's
+// stepped back up.  A frame's time is the longer of its CPU and GPU times, from the
+// profiler (see profiler.h), smoothed over about ten frames.  So that the quality doesn't
+// hunt up and down, it only steps down after governorDownFrames frames in a row over
+// budget, only steps up after governorUpFrames frames in a row well under it, and waits
+// governorCooldown frames after each step for the change to show in the times.
+//
+// Each level turns these knobs, roughly cheapest to see first:
+//   - Detail culling: objects smaller than some number of pixels across on screen aren't
+//     drawn (the coarsest level of detail there is, as meshes have no simpler versions).
+//   - The most lights with a range assigned to light clusters (see lights.h).
+//   - Animation rate: walking objects are moved on every nth frame, a different nth of
+//     them each frame, so matrices are rebuilt and the object tree updated less often.
+//   - Render scale: the scene is drawn into a framebuffer smaller than the window, then
+//     stretched to fit it with linear filtering.
+// The level and its settings are shown in the profiler's overlay, and written to its CSV.
+
+typedef struct {
+	float renderScale;
+	float detailPixels;  // Objects with a smaller radius on screen are culled (0 for none)
+	int lightBudget;
+	int animInterval;  // Frames between updates of each walking object
+} QualityLevel;
+
+const QualityLevel qualityLevels[] = {
+	{ 1.0f, 0.0f, maxLights, 1 },
+	{ 1.0f, 1.0f, maxLights, 1 },
+	{ 1.0f, 1.0f, 64, 1 },
+	{ 1.0f, 2.0f, 64, 2 },
+	{ 0.75f, 2.0f, 32, 2 },
+	{ 0.75f, 4.0f, 16, 3 },
+	{ 0.5f, 4.0f, 16, 4 },
+};
+const int numQualityLevels = sizeof(qualityLevels) / sizeof(qualityLevels[0]);
+
+const float governorSmoothing = 0.1f;  // The weight of each new frame time
+const float governorSpare = 0.7f;  // Under this fraction of the budget is well under
+const int governorDownFrames = 10;
+const int governorUpFrames = 60;
+const int governorCooldown = 30;
+
+bool governorOn = false;  // Set by the 'g' key or --governor
+float frameBudgetMs = 1000.0f / 60.0f;  // Set by --governor
+int qualityLevel = 0;
+QualityLevel quality = qualityLevels[0];
+
+float governedMs = -1.0f;  // Smoothed frame time, or -1 before the first
+int framesOver = 0, framesUnder = 0, governorWait = 0;
+
+static void describeQuality(char *text, size_t size) {
+	snprintf(text, size, "level %d of %d: %.0f%% scale, %.0f px detail, %d lights, animated every %d frame%s",
+			qualityLevel, numQualityLevels - 1, quality.renderScale * 100.0f, quality.detailPixels,
+			quality.lightBudget, quality.animInterval, quality.animInterval == 1 ? "" : "s");
+}
+
+void setQualityLevel(int level) {
+	qualityLevel = max(0, min(level, numQualityLevels - 1));
+	quality = qualityLevels[qualityLevel];
+	lightBudget = quality.lightBudget;
+	framesOver = framesUnder = 0;
+	governorWait = governorCooldown;
+
+	char text[160];
+	describeQuality(text, sizeof(text));
+	printf("Quality %s\n", text);
+}
+
+// Turn the governor on or off (going back to full quality).
+void setGovernor(bool on) {
+	governorOn = on;
+	governedMs = -1.0f;
+	if (qualityLevel != 0) {
+		setQualityLevel(0);
+	}
+	profileStatus[0] = '\0';
+}
+
+// Call after each frame's endProfileFrame.  Times come from the frame three before the
+// next, the latest whose GPU time is known.
+void governFrame() {
+	profileFrames[(profileFrameNum - 1) % profileHistory].quality = qualityLevel;
+	int n = profileFrameNum - 3;
+	if (!governorOn || n < 0) return;
+
+	const ProfileFrame *f = &profileFrames[n % profileHistory];
+	float ms = max(profileCPUTotal(f), f->gpuMs);
+	governedMs = governedMs < 0.0f ? ms : governedMs + (ms - governedMs) * governorSmoothing;
+	framesOver = governedMs > frameBudgetMs ? framesOver + 1 : 0;
+	framesUnder = governedMs < frameBudgetMs * governorSpare ? framesUnder + 1 : 0;
+
+	if (governorWait > 0) {
+		governorWait--;
+	} else if (framesOver >= governorDownFrames && qualityLevel < numQualityLevels - 1) {
+		setQualityLevel(qualityLevel + 1);
+	} else if (framesUnder >= governorUpFrames && qualityLevel > 0) {
+		setQualityLevel(qualityLevel - 1);
+	}
+
+	char text[160];
+	describeQuality(text, sizeof(text));
+	snprintf(profileStatus, sizeof(profileStatus), "Governor   %6.2f ms of %.1f, %s", governedMs, frameBudgetMs, text);
+}
+
+// ---- [Render scale] ---------------------------------------------------------
+
+GLuint scaledFBO = 0, scaledColor, scaledDepth;
+int scaledWidth = 0, scaledHeight = 0;  // The size of scaledFBO's buffers
+GLint scaleTarget;  // The framebuffer the frame ends up in
+int renderWidth, renderHeight;  // The size the frame is drawn at
+
+// Start a frame for a target of the given size, drawing into scaledFBO if the quality has
+// a reduced render scale.  renderWidth and renderHeight are the size it's drawn at.
+void beginScaledRender(int width, int height) {
+	renderWidth = width;
+	renderHeight = height;
+	if (quality.renderScale >= 1.0f) return;
+
+	renderWidth = max(1, (int) (width * quality.renderScale));
+	renderHeight = max(1, (int) (height * quality.renderScale));
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &scaleTarget); CheckError();
+	if (scaledFBO == 0) {
+		glGenFramebuffers(1, &scaledFBO); CheckError();
+		glGenRenderbuffers(1, &scaledColor); CheckError();
+		glGenRenderbuffers(1, &scaledDepth); CheckError();
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, scaledFBO); CheckError();
+	if (renderWidth != scaledWidth || renderHeight != scaledHeight) {
+		glBindRenderbuffer(GL_RENDERBUFFER, scaledColor); CheckError();
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, renderWidth, renderHeight); CheckError();
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, scaledColor); CheckError();
+		glBindRenderbuffer(GL_RENDERBUFFER, scaledDepth); CheckError();
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, renderWidth, renderHeight); CheckError();
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, scaledDepth); CheckError();
+
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER); CheckError();
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			failInt("Error - scaled framebuffer is incomplete, status:", status);
+		}
+		glDrawBuffer(GL_COLOR_ATTACHMENT0); CheckError();
+		glReadBuffer(GL_COLOR_ATTACHMENT0); CheckError();
+		scaledWidth = renderWidth;
+		scaledHeight = renderHeight;
+	}
+	glViewport(0, 0, renderWidth, renderHeight); CheckError();
+}
+
+// Stretch a scaled frame over its target, which is left bound.
+void endScaledRender(int width, int height) {
+	if (quality.renderScale >= 1.0f) return;
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, scaledFBO); CheckError();
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, scaleTarget); CheckError();
+	glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR); CheckError();
+	glBindFramebuffer(GL_FRAMEBUFFER, scaleTarget); CheckError();
+	glViewport(0, 0, width, height); CheckError();
+}
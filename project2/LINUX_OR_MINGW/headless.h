@@ -0,0 +1,251 @@
+// Rendering without a window, for benchmarks (headless.h)
+
+// With --headless the scene is drawn into a framebuffer object, in an OpenGL context that
+// has no window: an EGL context on Mesa's surfaceless platform, which needs neither an X
+// server nor a GPU (Mesa's llvmpipe renders on the CPU).  A saved scene is loaded and
+// drawn for a number of frames while the camera orbits it once, then the frame time
+// statistics and average counters are written as JSON (see runHeadlessBenchmark in
+// scene.cpp).  Frames can also be saved as PNG images, to check what was drawn.
+//
+// EGL is only linked in when building with make HEADLESS=1, which defines HAVE_EGL.
+
+#ifdef HAVE_EGL
+#  include <EGL/egl.h>
+#  include <EGL/eglext.h>
+#endif
+
+#include <algorithm>  // sort
+
+#include "pngwrite.h"
+
+bool headlessMode = false;  // Set by --headless
+int benchSlot = -1;  // The save slot to load (--slot), or -1 for the starting scene.
+int benchFrames = 300;  // Frames timed, over one orbit of the camera (--frames)
+int benchWarmup = 10;  // Frames drawn before timing starts (--warmup)
+const char *benchJSONFile = NULL;  // Where to write the results (--json), or stdout.
+const char *benchPNGPrefix = NULL;  // If set, frames are saved as PREFIX0000.png, ... (--png)
+int benchPNGEvery = 60;  // Save every this many frames (--png-every)
+
+GLuint headlessFBO = 0;
+GLuint headlessColor = 0, headlessDepth = 0;  // Renderbuffers
+
+#ifdef HAVE_EGL
+static GLExtraProc eglProcAddress(const char *name) {
+	return (GLExtraProc) eglGetProcAddress(name);
+}
+
+// Create an OpenGL 3.2 compatibility context with no surface, make it current, and load
+// the entry points (as glewInit and LoadGLExtra do after glutCreateWindow).
+void createHeadlessContext() {
+	EGLDisplay display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay != NULL) {
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (display == EGL_NO_DISPLAY) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);  // Not Mesa: try the default platform
+	}
+
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		fprintf(stderr, "Error: Could not initialise EGL (0x%x)\n", eglGetError());
+		exit(EXIT_FAILURE);
+	}
+	const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+	if (extensions == NULL || strstr(extensions, "EGL_KHR_surfaceless_context") == NULL) {
+		fprintf(stderr, "Error: EGL %d.%d doesn't support contexts without a surface\n", major, minor);
+		exit(EXIT_FAILURE);
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		fprintf(stderr, "Error: EGL doesn't support desktop OpenGL\n");
+		exit(EXIT_FAILURE);
+	}
+
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config = EGL_NO_CONFIG_KHR;  // Allowed with EGL_KHR_no_config_context
+	EGLint nConfigs = 0;
+	eglChooseConfig(display, configAttribs, &config, 1, &nConfigs);
+	if (nConfigs == 0) config = EGL_NO_CONFIG_KHR;
+
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 2,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_CONTEXT_OPENGL_DEBUG, GL_CHECK_LEVEL >= 1 ? EGL_TRUE : EGL_FALSE,  // As GLUT_DEBUG
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		fprintf(stderr, "Error: Could not create an OpenGL 3.2 context with EGL (0x%x)\n", eglGetError());
+		exit(EXIT_FAILURE);
+	}
+
+	glewExperimental = GL_TRUE;
+	glewInit(); CheckError();
+	LoadGLExtra(eglProcAddress);
+
+	printf("Headless rendering with %s (EGL %d.%d)\n", glGetString(GL_RENDERER), major, minor);
+}
+#else
+void createHeadlessContext() {
+	fprintf(stderr, "Error: --headless needs EGL, which this build doesn't use (build with make HEADLESS=1)\n");
+	exit(EXIT_FAILURE);
+}
+#endif
+
+// Make a framebuffer with colour and depth renderbuffers, and draw into it from now on.
+void createRenderTarget(int width, int height) {
+	glGenFramebuffers(1, &headlessFBO); CheckError();
+	glBindFramebuffer(GL_FRAMEBUFFER, headlessFBO); CheckError();
+
+	glGenRenderbuffers(1, &headlessColor); CheckError();
+	glBindRenderbuffer(GL_RENDERBUFFER, headlessColor); CheckError();
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height); CheckError();
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headlessColor); CheckError();
+
+	glGenRenderbuffers(1, &headlessDepth); CheckError();
+	glBindRenderbuffer(GL_RENDERBUFFER, headlessDepth); CheckError();
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height); CheckError();
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, headlessDepth); CheckError();
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER); CheckError();
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		failInt("Error - headless framebuffer is incomplete, status:", status);
+	}
+	glDrawBuffer(GL_COLOR_ATTACHMENT0); CheckError();
+	glReadBuffer(GL_COLOR_ATTACHMENT0); CheckError();
+}
+
+// Save what's in the framebuffer as PREFIXnnnn.png.
+void saveFramePNG(const char *prefix, int frame, int width, int height) {
+	unsigned char *rgb = (unsigned char*) malloc((size_t) width * height * 3);
+	if (rgb == NULL) {
+		failInt("Error - out of memory for a frame image, pixels:", width * height);
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 1); CheckError();
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, rgb); CheckError();
+
+	char fileName[256];
+	snprintf(fileName, sizeof(fileName), "%s%04d.png", prefix, frame);
+	writePNG(fileName, width, height, rgb);
+	free(rgb);
+}
+
+// ---- [Results] --------------------------------------------------------------
+
+// Statistics of a run's frame times, in milliseconds.
+typedef struct {
+	double mean, p50, p95, p99, min, max;
+} FrameTimeStats;
+
+// The value below which p percent of the (sorted) values fall (nearest rank).
+static double percentile(const double *sorted, int n, double p) {
+	int rank = (int) ceil(p / 100.0 * n);
+	return sorted[min(max(rank, 1), n) - 1];
+}
+
+FrameTimeStats summarizeFrameTimes(const double *frameTimes, int n) {
+	double *sorted = (double*) malloc(sizeof(double) * n);
+	if (sorted == NULL) {
+		failInt("Error - out of memory for frame times:", n);
+	}
+	memcpy(sorted, frameTimes, sizeof(double) * n);
+	sort(sorted, sorted + n);
+
+	FrameTimeStats st;
+	double total = 0.0;
+	for (int i = 0; i < n; i++) {
+		total += sorted[i];
+	}
+	st.mean = total / n;
+	st.p50 = percentile(sorted, n, 50.0);
+	st.p95 = percentile(sorted, n, 95.0);
+	st.p99 = percentile(sorted, n, 99.0);
+	st.min = sorted[0];
+	st.max = sorted[n - 1];
+	free(sorted);
+	return st;
+}
+
+static FILE *openBenchOutput(const char *fileName) {
+	FILE *out = fileName != NULL ? fopen(fileName, "w") : stdout;
+	if (out == NULL) {
+		fprintf(stderr, "Error: Could not open '%s' for writing\n", fileName);
+		exit(EXIT_FAILURE);
+	}
+	return out;
+}
+
+// Write frame time statistics and the average of each frame counter (see framestats.h)
+// as JSON, to fileName or to stdout if it's NULL.
+void writeBenchJSON(const char *fileName, const double *frameTimes, int n, int width, int height) {
+	FrameTimeStats st = summarizeFrameTimes(frameTimes, n);
+	FILE *out = openBenchOutput(fileName);
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"renderer\": \"%s\",\n", glGetString(GL_RENDERER));
+	fprintf(out, "  \"version\": \"%s\",\n", glGetString(GL_VERSION));
+	fprintf(out, "  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %d,\n", width, height, n);
+	fprintf(out, "  \"frame_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"min\": %.4f, \"max\": %.4f},\n",
+			st.mean, st.p50, st.p95, st.p99, st.min, st.max);
+	fprintf(out, "  \"per_frame\": {");
+	const char *separator = "\n";
+#define PrintStat(name, desc)  fprintf(out, "%s    \"%s\": %.2f", separator, #name, (double) statsTotals.name / max(statsFrames, 1)); separator = ",\n";
+	FRAME_STATS(PrintStat)
+#undef PrintStat
+	fprintf(out, "\n  }\n}\n");
+
+	if (out != stdout) {
+		fclose(out);
+		printf("Wrote %s: mean %.3f ms, p95 %.3f ms over %d frames\n", fileName, st.mean, st.p95, n);
+	}
+}
+
+// ---- [Scalability suite] ----------------------------------------------------
+
+// With --bench-suite, each kind of generated scene is timed at each size (see
+// runBenchSuite in scene.cpp), and the results printed as a table and optionally written
+// as JSON.  Run it with make bench HEADLESS=1.
+bool benchSuite = false;  // Set by --bench-suite
+
+const char *benchSceneKinds[] = { "static", "animated", "mixed" };
+const int numBenchSceneKinds = 3;
+const int benchSceneSizes[] = { 10, 100, 1000, 10000 };
+const int numBenchSceneSizes = 4;
+
+typedef struct {
+	const char *kind;
+	int objects;
+	FrameTimeStats frameMs;
+	double drawCalls, instancesDrawn, objectsCulled;  // Averages per frame
+} BenchResult;
+
+void printBenchTable(const BenchResult *results, int n) {
+	printf("\n%-9s %8s %10s %10s %10s %12s %10s\n", "scene", "objects", "mean ms", "p95 ms", "p99 ms",
+			"draw calls", "drawn");
+	for (int r = 0; r < n; r++) {
+		const BenchResult *res = &results[r];
+		printf("%-9s %8d %10.3f %10.3f %10.3f %12.1f %10.1f\n", res->kind, res->objects, res->frameMs.mean,
+				res->frameMs.p95, res->frameMs.p99, res->drawCalls, res->instancesDrawn);
+	}
+	fflush(stdout);
+}
+
+void writeBenchSuiteJSON(const char *fileName, const BenchResult *results, int n, int frames) {
+	FILE *out = openBenchOutput(fileName);
+	fprintf(out, "{\n  \"renderer\": \"%s\",\n  \"frames\": %d,\n  \"results\": [\n", glGetString(GL_RENDERER), frames);
+	for (int r = 0; r < n; r++) {
+		const BenchResult *res = &results[r];
+		fprintf(out, "    {\"scene\": \"%s\", \"objects\": %d, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, "
+				"\"p99_ms\": %.4f, \"draw_calls\": %.2f, \"instances_drawn\": %.2f, \"objects_culled\": %.2f}%s\n",
+				res->kind, res->objects, res->frameMs.mean, res->frameMs.p50, res->frameMs.p95, res->frameMs.p99,
+				res->drawCalls, res->instancesDrawn, res->objectsCulled, r + 1 < n ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+	if (out != stdout) fclose(out);
+}
@@ -0,0 +1,8 @@
+#version 150
+
+in vec4 color;
+out vec4 fColor;
+
+void main() {
+	fColor = color;
+}
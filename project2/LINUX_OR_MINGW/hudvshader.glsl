@@ -0,0 +1,14 @@
+#version 150
+
+// Draws the profiler overlay (see profiler.h)
+
+in vec2 vPosition;  // In window coordinates
+in vec4 vColor;
+out vec4 color;
+
+uniform mat4 Projection;  // Window to clip coordinates
+
+void main() {
+	gl_Position = Projection * vec4(vPosition, 0.0, 1.0);
+	color = vColor;
+}
@@ -0,0 +1,105 @@
+// Uniform block data and instanced batches (instancing.h)
+
+// Objects that share a mesh and texture are drawn together as instances of one draw (a
+// batch).  What differs between them is in an ObjectData record: the vertex shader reads
+// objects[vInstance] from the ObjectBlock uniform block, which is bound to the records in
+// the uniform ring buffer with glBindBufferRange (see mesharena.h for vInstance).  Data
+// that's the same for the whole frame (projection, view and the light cluster grid) is in
+// one FrameData record, bound to the FrameBlock uniform block.
+//
+// FrameData and ObjectData mirror the std140 layout of the blocks in the shaders.
+
+const int maxInstancesPerDraw = 128;  // Must match MAX_INSTANCES in vshader.glsl.
+const GLuint frameBlockBinding = 0, objectBlockBinding = 1;
+
+typedef struct {
+	GLfloat projection[16];  // Column-major, like all matrices in uniform blocks.
+	GLfloat view[16];
+	GLfloat clusterScale[4];  // The light cluster grid (see lights.h).
+	GLint clusterGrid[4];
+} FrameData;
+
+typedef struct {
+	GLfloat modelView[16];
+	GLfloat ambient[4];  // Ambient product, and the texture scale in w.
+	GLfloat diffuse[4];  // Diffuse product, and the first matrix of the bone palette in w (see bonepalette.h).
+	GLfloat specular[4];  // Specular product, and the shininess in w.
+} ObjectData;
+
+const GLsizeiptr objectBlockSize = sizeof(ObjectData) * maxInstancesPerDraw;
+
+typedef struct {
+	int meshId, texId;
+	int first, count;  // The range of the render queue drawn by the batch.
+	int baseInstance;  // Where the batch's ObjectData records start in its group's block (see multidraw.h).
+	GLuint conditionQuery;  // If not 0, the batch is drawn only if this query passed (see occlusion.h).
+} DrawBatch;
+
+DrawBatch *batches = NULL;
+int nBatches = 0, batchCapacity = 0;
+
+GLint uniformOffsetAlignment = 256;  // Set from GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+
+// Check a program's uniform blocks match FrameData and ObjectData, then bind them.
+void bindUniformBlocks(GLuint program) {
+	const ShaderBlock *frame = FindUniformBlock(program, "FrameBlock");
+	const ShaderBlock *object = FindUniformBlock(program, "ObjectBlock");
+	if (frame == NULL || object == NULL) {
+		fprintf(stderr, "Error: shader program is missing FrameBlock or ObjectBlock\n");
+		exit(EXIT_FAILURE);
+	}
+	if (frame->dataSize != (GLint) sizeof(FrameData) || object->dataSize != (GLint) objectBlockSize) {
+		fprintf(stderr, "Error: uniform block sizes %d and %d don't match FrameData and ObjectData\n",
+				frame->dataSize, object->dataSize);
+		exit(EXIT_FAILURE);
+	}
+
+	glUniformBlockBinding(program, frame->index, frameBlockBinding); CheckError();
+	glUniformBlockBinding(program, object->index, objectBlockBinding); CheckError();
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformOffsetAlignment); CheckError();
+}
+
+// Store an (Angel, row-major) matrix in column-major order.
+void storeMatrix(GLfloat *dst, const mat4 &m) {
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			dst[col * 4 + row] = m[row][col];
+		}
+	}
+}
+
+void setObjectData(ObjectData *obj, const mat4 &modelView, const vec3 &ambient, const vec3 &diffuse,
+		const vec3 &specular, float shine, float texScale, GLint palette) {
+	storeMatrix(obj->modelView, modelView);
+	for (int c = 0; c < 3; c++) {
+		obj->ambient[c] = ambient[c];
+		obj->diffuse[c] = diffuse[c];
+		obj->specular[c] = specular[c];
+	}
+	obj->ambient[3] = texScale;
+	obj->diffuse[3] = palette;
+	obj->specular[3] = shine;
+}
+
+void resetBatches() {
+	nBatches = 0;
+}
+
+DrawBatch *addBatch(int meshId, int texId, int first, int count) {
+	if (nBatches == batchCapacity) {
+		batchCapacity = max(64, batchCapacity * 2);
+		batches = (DrawBatch*) realloc(batches, sizeof(DrawBatch) * batchCapacity);
+		if (batches == NULL) {
+			failInt("Error - out of memory for draw batches:", batchCapacity);
+		}
+	}
+
+	DrawBatch *b = &batches[nBatches++];
+	b->meshId = meshId;
+	b->texId = texId;
+	b->first = first;
+	b->count = count;
+	b->baseInstance = 0;
+	b->conditionQuery = 0;
+	return b;
+}
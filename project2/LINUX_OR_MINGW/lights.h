@@ -0,0 +1,316 @@
+// Lights, and clustered forward shading (lights.h)
+
+// Lights are a list.  Each is either shown by a scene object (a small sphere, whose
+// location, colour and brightness are the light's) or free standing.  A light with a
+// range fades out completely at that distance, so only fragments near it need to
+// consider it; a light with no range (light 2) reaches every fragment.
+//
+// Each frame the view volume is split into clusters: clusterTilesX x clusterTilesY tiles
+// across the screen, each cut into clusterSlices slices by depth (spaced exponentially,
+// so clusters are roughly as deep as they are wide).  Every ranged light is added to the
+// list of each cluster its sphere touches.  The lights, each cluster's offset and count,
+// and the lists go into buffer textures, and the fragment shader loops over only the
+// lights in its own cluster - so the cost of a fragment depends on how many lights
+// overlap it, not on how many lights there are.
+
+const int maxLights = 1024;
+
+const int clusterTilesX = 16, clusterTilesY = 9, clusterSlices = 24;
+const int numClusters = clusterTilesX * clusterTilesY * clusterSlices;
+
+// Texture units for the buffer textures (unit 0 is the object's texture).
+const int lightDataUnit = 1, clusterDataUnit = 2, lightIndexUnit = 3;
+
+typedef struct {
+	ObjectHandle object;  // The object showing the light, or noObject for a free standing light.
+	vec4 position;  // In world coordinates.  These three are the object's, if it has one.
+	vec3 rgb;
+	float brightness;
+	float range;  // Where the light has faded out, or 0 for a light that reaches everything.
+	bool viewRelative;  // Placed relative to the camera's rotation, rather than the scene.
+} Light;
+
+Light lights[maxLights];
+int nLights = 0;
+
+typedef struct {
+	GLuint buffers[3], textures[3];  // Light data, cluster offsets and counts, light indices.
+	GLint maxTexels;  // GL_MAX_TEXTURE_BUFFER_SIZE
+
+	// From the projection (see setClusterProjection).
+	float boxMin[numClusters][3], boxMax[numClusters][3];  // Each cluster's bounds, in eye coordinates.
+	float sliceScale, sliceBias;  // slice = log(depth) * sliceScale + sliceBias
+	float nearDist, xScale, xBias, yScale, yBias;  // x_ndc = x * xScale / depth - xBias, same for y
+
+	// Built each frame by assignLights.
+	GLfloat lightTexels[maxLights * 2][4];  // Eye position and range, then colour and brightness.
+	int nGlobal, nGPULights;  // Lights with no range come first.
+	GLuint clusterRanges[numClusters][2];  // Offset and count in the index list.
+	GLuint *refs;  // Cluster * maxLights + light, for each light touching each cluster.
+	GLuint *indices;
+	int nRefs, refCapacity;
+} LightClusters;
+
+LightClusters lightClusters;
+int lightBudget = maxLights;  // The most lights with a range assigned each frame (see governor.h)
+
+int addLight(ObjectHandle object, const vec4 &position, const vec3 &rgb, float brightness, float range) {
+	if (nLights == maxLights) return -1;
+	Light *l = &lights[nLights];
+	l->object = object;
+	l->position = position;
+	l->rgb = rgb;
+	l->brightness = brightness;
+	l->range = range;
+	l->viewRelative = false;
+	return nLights++;
+}
+
+// The two lights every scene has: objects 1 and 2.  Light 1 is a point light, and light 2
+// lights everything from a place that turns with the camera.
+void resetLights() {
+	nLights = 0;
+	addLight(objectHandle(1), vec4(0.0, 0.0, 0.0, 1.0), vec3(1.0, 1.0, 1.0), 1.0, 40.0);
+	int l2 = addLight(objectHandle(2), vec4(0.0, 0.0, 0.0, 1.0), vec3(1.0, 1.0, 1.0), 1.0, 0.0);
+	lights[l2].viewRelative = true;
+}
+
+// Add free standing lights of random colours, with short ranges, scattered just above
+// the ground (for testing many lights).
+int extraLights = 0;  // Set by --lights
+
+void addRandomLights(int n) {
+	for (int k = 0; k < n; k++) {
+		float x = -9.0f + 18.0f * rand() / RAND_MAX, z = -9.0f + 18.0f * rand() / RAND_MAX;
+		float y = 0.2f + 0.8f * rand() / RAND_MAX;
+		vec3 rgb(0.2f + 0.8f * rand() / RAND_MAX, 0.2f + 0.8f * rand() / RAND_MAX, 0.2f + 0.8f * rand() / RAND_MAX);
+		addLight(noObject, vec4(x, y, z, 1.0), rgb, 0.5, 1.5f + 1.5f * rand() / RAND_MAX);
+	}
+}
+
+// Remove any lights shown by objects that have been deleted, or are numbered firstObject
+// or more.
+void removeLightsFrom(int firstObject) {
+	int kept = 0;
+	for (int l = 0; l < nLights; l++) {
+		int i = objectIndex(lights[l].object);
+		if (lights[l].object.slot < 0 || (i >= 0 && i < firstObject)) lights[kept++] = lights[l];
+	}
+	nLights = kept;
+}
+
+// Make the buffer textures, and bind them to their texture units for good.
+void initLights() {
+	LightClusters *lc = &lightClusters;
+	GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+	GLenum units[3] = { lightDataUnit, clusterDataUnit, lightIndexUnit };
+
+	glGenBuffers(3, lc->buffers); CheckError();
+	glGenTextures(3, lc->textures); CheckError();
+	for (int b = 0; b < 3; b++) {
+		glBindBuffer(GL_TEXTURE_BUFFER, lc->buffers[b]); CheckError();
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW); CheckError();
+		glActiveTexture(GL_TEXTURE0 + units[b]); CheckError();
+		glBindTexture(GL_TEXTURE_BUFFER, lc->textures[b]); CheckError();
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[b], lc->buffers[b]); CheckError();
+	}
+	glActiveTexture(GL_TEXTURE0); CheckError();
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &lc->maxTexels); CheckError();
+}
+
+// Find each cluster's bounds from the projection (made by Frustum), and its near and
+// far distances.
+void setClusterProjection(const mat4 &proj, float nearDist, float farDist) {
+	LightClusters *lc = &lightClusters;
+	lc->nearDist = nearDist;
+	lc->sliceScale = clusterSlices / log(farDist / nearDist);
+	lc->sliceBias = -log(nearDist) * lc->sliceScale;
+	lc->xScale = proj[0][0];
+	lc->xBias = proj[0][2];
+	lc->yScale = proj[1][1];
+	lc->yBias = proj[1][2];
+
+	for (int s = 0; s < clusterSlices; s++) {
+		float depth[2] = { nearDist * (float) pow(farDist / nearDist, (double) s / clusterSlices),
+				nearDist * (float) pow(farDist / nearDist, (double) (s + 1) / clusterSlices) };
+		for (int ty = 0; ty < clusterTilesY; ty++) {
+			for (int tx = 0; tx < clusterTilesX; tx++) {
+				int c = (s * clusterTilesY + ty) * clusterTilesX + tx;
+				float *lo = lc->boxMin[c], *hi = lc->boxMax[c];
+				lo[0] = lo[1] = 1e30f;
+				hi[0] = hi[1] = -1e30f;
+				for (int k = 0; k < 8; k++) {
+					float d = depth[k & 1];
+					float ndcX = -1.0f + 2.0f * (tx + ((k >> 1) & 1)) / clusterTilesX;
+					float ndcY = -1.0f + 2.0f * (ty + ((k >> 2) & 1)) / clusterTilesY;
+					float x = d * (ndcX + lc->xBias) / lc->xScale;
+					float y = d * (ndcY + lc->yBias) / lc->yScale;
+					lo[0] = min(lo[0], x);
+					hi[0] = max(hi[0], x);
+					lo[1] = min(lo[1], y);
+					hi[1] = max(hi[1], y);
+				}
+				lo[2] = -depth[1];
+				hi[2] = -depth[0];
+			}
+		}
+	}
+}
+
+static int clusterSlice(const LightClusters *lc, float depth) {
+	int s = (int) floor(log(max(depth, lc->nearDist)) * lc->sliceScale + lc->sliceBias);
+	return min(max(s, 0), clusterSlices - 1);
+}
+
+static int clusterTile(float ndc, int tiles) {
+	return min(max((int) floor((ndc + 1.0f) * 0.5f * tiles), 0), tiles - 1);
+}
+
+// Add a light to every cluster its sphere (in eye coordinates) touches.
+static void addLightRefs(LightClusters *lc, int g, const vec4 &eye, float r) {
+	float d = -eye.z;
+	if (d + r < lc->nearDist) return;  // Behind the camera
+
+	// The tiles covered by the sphere's box on the screen, unless it reaches the near plane.
+	int x0 = 0, x1 = clusterTilesX - 1, y0 = 0, y1 = clusterTilesY - 1;
+	if (d - r > lc->nearDist) {
+		float ndc[2][2];  // x then y, min then max
+		for (int a = 0; a < 2; a++) {
+			float scale = a == 0 ? lc->xScale : lc->yScale, bias = a == 0 ? lc->xBias : lc->yBias;
+			float lo = eye[a] - r, hi = eye[a] + r;
+			ndc[a][0] = min(scale * lo / (d - r), scale * lo / (d + r)) - bias;
+			ndc[a][1] = max(scale * hi / (d - r), scale * hi / (d + r)) - bias;
+			if (ndc[a][1] < -1.0f || ndc[a][0] > 1.0f) return;  // Off the screen
+		}
+		x0 = clusterTile(ndc[0][0], clusterTilesX);
+		x1 = clusterTile(ndc[0][1], clusterTilesX);
+		y0 = clusterTile(ndc[1][0], clusterTilesY);
+		y1 = clusterTile(ndc[1][1], clusterTilesY);
+	}
+
+	int s1 = clusterSlice(lc, d + r);
+	for (int s = clusterSlice(lc, d - r); s <= s1; s++) {
+		for (int ty = y0; ty <= y1; ty++) {
+			for (int tx = x0; tx <= x1; tx++) {
+				int c = (s * clusterTilesY + ty) * clusterTilesX + tx;
+
+				// Does the sphere touch the cluster's box?
+				float dist2 = 0.0f;
+				for (int a = 0; a < 3; a++) {
+					float e = max(max(lc->boxMin[c][a] - eye[a], eye[a] - lc->boxMax[c][a]), 0.0f);
+					dist2 += e * e;
+				}
+				if (dist2 > r * r) continue;
+
+				if (lc->nRefs == lc->refCapacity) {
+					if (lc->refCapacity == lc->maxTexels) return;  // The index texture is full
+					lc->refCapacity = min(max(4096, lc->refCapacity * 2), lc->maxTexels);
+					lc->refs = (GLuint*) realloc(lc->refs, sizeof(GLuint) * lc->refCapacity);
+					lc->indices = (GLuint*) realloc(lc->indices, sizeof(GLuint) * lc->refCapacity);
+					if (lc->refs == NULL || lc->indices == NULL) {
+						failInt("Error - out of memory for light lists:", lc->refCapacity);
+					}
+				}
+				lc->refs[lc->nRefs++] = c * maxLights + g;
+			}
+		}
+	}
+}
+
+// Put every light in eye coordinates, and build the light list of each cluster.
+// cameraRot is the camera's rotation, for lights placed relative to it.  Lights with a
+// range are left out when reachesVisible (if given) says nothing visible is in range, and
+// once lightBudget of them have been assigned.
+void assignLights(const mat4 &view, const mat4 &cameraRot, bool (*reachesVisible)(const vec4 &position, float range)) {
+	LightClusters *lc = &lightClusters;
+	lc->nGPULights = 0;
+	lc->nRefs = 0;
+
+	// Lights with no range go first, so the shader can loop over them all.
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass == 1) lc->nGlobal = lc->nGPULights;
+		for (int l = 0; l < nLights; l++) {
+			Light *light = &lights[l];
+			if ((light->range > 0.0f) != (pass == 1)) continue;
+
+			vec4 position = light->position;
+			vec3 rgb = light->rgb;
+			float brightness = light->brightness;
+			if (light->object.slot >= 0) {
+				int i = objectIndex(light->object);
+				if (i < 0) continue;  // Deleted since (see removeLightsFrom)
+				position = objectLoc(i);
+				rgb = objectRGB(i);
+				brightness = materials.brightness[i];
+			}
+			if (pass == 1 && !light->viewRelative && reachesVisible != NULL && !reachesVisible(position, light->range)) {
+				frameStats.lightsUnseen++;
+				continue;
+			}
+			if (pass == 1 && lc->nGPULights - lc->nGlobal >= lightBudget) {
+				frameStats.lightsDropped++;
+				continue;
+			}
+			vec4 eye = (light->viewRelative ? cameraRot : view) * position;
+
+			int g = lc->nGPULights++;
+			GLfloat *where = lc->lightTexels[g * 2], *color = lc->lightTexels[g * 2 + 1];
+			for (int c = 0; c < 3; c++) {
+				where[c] = eye[c];
+				color[c] = rgb[c] * brightness;
+			}
+			where[3] = light->range;
+			color[3] = brightness;  // Specular highlights only use the brightness
+
+			if (pass == 1) {
+				addLightRefs(lc, g, eye, light->range);
+			}
+		}
+	}
+
+	// Sort the references by cluster (a counting sort), giving each cluster's list.
+	memset(lc->clusterRanges, 0, sizeof(lc->clusterRanges));
+	for (int k = 0; k < lc->nRefs; k++) {
+		lc->clusterRanges[lc->refs[k] / maxLights][1]++;
+	}
+	GLuint offset = 0;
+	for (int c = 0; c < numClusters; c++) {
+		lc->clusterRanges[c][0] = offset;
+		offset += lc->clusterRanges[c][1];
+		lc->clusterRanges[c][1] = 0;
+	}
+	for (int k = 0; k < lc->nRefs; k++) {
+		GLuint *range = lc->clusterRanges[lc->refs[k] / maxLights];
+		lc->indices[range[0] + range[1]++] = lc->refs[k] % maxLights;
+	}
+	frameStats.lightRefs += lc->nRefs;
+}
+
+// Replace the contents of the buffer textures.  They're respecified each frame, so the
+// driver can hand out new storage rather than wait for the GPU to finish with the old.
+void uploadLights() {
+	LightClusters *lc = &lightClusters;
+	const void *data[3] = { lc->lightTexels, lc->clusterRanges, lc->indices };
+	GLsizeiptr sizes[3] = { (GLsizeiptr) sizeof(GLfloat) * 8 * lc->nGPULights, (GLsizeiptr) sizeof(lc->clusterRanges),
+			(GLsizeiptr) sizeof(GLuint) * lc->nRefs };
+	for (int b = 0; b < 3; b++) {
+		glBindBuffer(GL_TEXTURE_BUFFER, lc->buffers[b]); CheckError();
+		glBufferData(GL_TEXTURE_BUFFER, max(sizes[b], (GLsizeiptr) 16), NULL, GL_STREAM_DRAW); CheckError();
+		if (sizes[b] > 0) {
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, sizes[b], data[b]); CheckError();
+		}
+	}
+}
+
+// Set the cluster grid's part of the frame's uniform block, for a window of the given size.
+void setClusterFrameData(FrameData *frame, int width, int height) {
+	LightClusters *lc = &lightClusters;
+	frame->clusterScale[0] = (float) width / clusterTilesX;
+	frame->clusterScale[1] = (float) height / clusterTilesY;
+	frame->clusterScale[2] = lc->sliceScale;
+	frame->clusterScale[3] = lc->sliceBias;
+	frame->clusterGrid[0] = clusterTilesX;
+	frame->clusterGrid[1] = clusterTilesY;
+	frame->clusterGrid[2] = clusterSlices;
+	frame->clusterGrid[3] = lc->nGlobal;
+}
@@ -0,0 +1,194 @@
+// Micro-benchmarks of the Angel math types (mathbench.h)
+
+// --bench-math: times mat4 products, transposes and matrix-vector products (which work in
+// SIMD registers, see ../../include/mat.h) over arrays of random matrices, against plain
+// element-by-element versions like those the library used to have, and checks they agree.
+// The arrays are small enough to stay in cache, so it's the arithmetic that's timed.
+// Prints a table and exits.
+
+static unsigned int mathBenchSeed = 1;
+
+static float mathBenchRandom() {  // -1 to 1
+	mathBenchSeed = mathBenchSeed * 1664525u + 1013904223u;
+	return (mathBenchSeed >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+static mat4 scalarMultiply(const mat4 &a, const mat4 &b) {
+	mat4 c(0.0);
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			for (int k = 0; k < 4; k++) {
+				c[i][j] += a[i][k] * b[k][j];
+			}
+		}
+	}
+	return c;
+}
+
+static mat4 scalarTranspose(const mat4 &a) {
+	mat4 t;
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			t[i][j] = a[j][i];
+		}
+	}
+	return t;
+}
+
+static vec4 scalarTransform(const mat4 &a, const vec4 &v) {
+	vec4 u;
+	for (int i = 0; i < 4; i++) {
+		u[i] = a[i][0] * v.x + a[i][1] * v.y + a[i][2] * v.z + a[i][3] * v.w;
+	}
+	return u;
+}
+
+static float vecDifference(const vec4 &a, const vec4 &b) {
+	float d = 0.0f;
+	for (int c = 0; c < 4; c++) {
+		d = max(d, fabsf(a[c] - b[c]));
+	}
+	return d;
+}
+
+static float matDifference(const mat4 &a, const mat4 &b) {
+	float d = 0.0f;
+	for (int r = 0; r < 4; r++) {
+		d = max(d, vecDifference(a[r], b[r]));
+	}
+	return d;
+}
+
+static void printMathBench(const char *name, double seconds, double scalarSeconds, long ops, float difference) {
+	printf("%-16s %10.2f %10.2f %8.2fx %12g\n", name, seconds * 1e9 / ops, scalarSeconds * 1e9 / ops,
+			scalarSeconds / seconds, difference);
+}
+
+void benchMath() {
+	const int n = 1024;  // A power of 2, for the index masks
+	const int reps = 2000;
+	const long ops = (long) n * reps;
+	// Aligned like the scene's object arrays (see sceneobjects.h), as new only aligns
+	// mat4 and vec4 properly from C++17.  Every element is written before it's read.
+	mat4 *a = (mat4*) alignedAlloc(sizeof(mat4) * n), *b = (mat4*) alignedAlloc(sizeof(mat4) * n);
+	mat4 *c = (mat4*) alignedAlloc(sizeof(mat4) * n), *d = (mat4*) alignedAlloc(sizeof(mat4) * n);
+	vec4 *v = (vec4*) alignedAlloc(sizeof(vec4) * n), *u = (vec4*) alignedAlloc(sizeof(vec4) * n);
+	vec4 *w = (vec4*) alignedAlloc(sizeof(vec4) * n);
+	if (a == NULL || b == NULL || c == NULL || d == NULL || v == NULL || u == NULL || w == NULL) {
+		failInt("Error - out of memory for benchmark matrices:", n);
+	}
+	for (int i = 0; i < n; i++) {
+		for (int r = 0; r < 4; r++) {
+			a[i][r] = vec4(mathBenchRandom(), mathBenchRandom(), mathBenchRandom(), mathBenchRandom());
+			b[i][r] = vec4(mathBenchRandom(), mathBenchRandom(), mathBenchRandom(), mathBenchRandom());
+		}
+		v[i] = vec4(mathBenchRandom(), mathBenchRandom(), mathBenchRandom(), 1.0f);
+	}
+
+	// Each rep pairs the arrays differently, so no work can be hoisted out of the reps, and
+	// an element of each rep's results is summed so none can be skipped.
+	printf("Angel math with %s: nanoseconds per operation, with %d-element arrays\n", ANGEL_SIMD_NAME, n);
+	printf("%-16s %10s %10s %9s %12s\n", "Operation", "mat.h", "Scalar", "Speedup", "Difference");
+	float sum = 0.0f;
+
+	double start = clockSeconds();
+	for (int r = 0; r < reps; r++) {
+		for (int i = 0; i < n; i++) {
+			c[i] = a[i] * b[(i + r) & (n - 1)];
+		}
+		sum += c[r & (n - 1)][1][2];
+	}
+	double simdTime = clockSeconds() - start;
+	start = clockSeconds();
+	for (int r = 0; r < reps; r++) {
+		for (int i = 0; i < n; i++) {
+			d[i] = scalarMultiply(a[i], b[(i + r) & (n - 1)]);
+		}
+		sum += d[r & (n - 1)][1][2];
+	}
+	double scalarTime = clockSeconds() - start;
+	float diff = 0.0f;
+	for (int i = 0; i < n; i++) {
+		diff = max(diff, matDifference(c[i], d[i]));
+	}
+	printMathBench("mat4 * mat4", simdTime, scalarTime, ops, diff);
+
+	start = clockSeconds();
+	for (int r = 0; r < reps; r++) {
+		for (int i = 0; i < n; i++) {
+			c[i] = transpose(a[(i + r) & (n - 1)]);
+		}
+		sum += c[r & (n - 1)][1][2];
+	}
+	simdTime = clockSeconds() - start;
+	start = clockSeconds();
+	for (int r = 0; r < reps; r++) {
+		for (int i = 0; i < n; i++) {
+			d[i] = scalarTranspose(a[(i + r) & (n - 1)]);
+		}
+		sum += d[r & (n - 1)][1][2];
+	}
+	scalarTime = clockSeconds() - start;
+	diff = 0.0f;
+	for (int i = 0; i < n; i++) {
+		diff = max(diff, matDifference(c[i], d[i]));
+	}
+	printMathBench("transpose", simdTime, scalarTime, ops, diff);
+
+	start = clockSeconds();
+	for (int r = 0; r < reps; r++) {
+		for (int i = 0; i < n; i++) {
+			u[i] = a[i] * v[(i + r) & (n - 1)];
+		}
+		sum += u[r & (n - 1)].y;
+	}
+	simdTime = clockSeconds() - start;
+	start = clockSeconds();
+	for (int r = 0; r < reps; r++) {
+		for (int i = 0; i < n; i++) {
+			w[i] = scalarTransform(a[i], v[(i + r) & (n - 1)]);
+		}
+		sum += w[r & (n - 1)].y;
+	}
+	scalarTime = clockSeconds() - start;
+	diff = 0.0f;
+	for (int i = 0; i < n; i++) {
+		diff = max(diff, vecDifference(u[i], w[i]));
+	}
+	printMathBench("mat4 * vec4", simdTime, scalarTime, ops, diff);
+
+	// A model-view matrix built and applied as the scene does: a product of four matrices,
+	// then a point transformed by it.
+	start = clockSeconds();
+	for (int r = 0; r < reps; r++) {
+		for (int i = 0; i < n; i++) {
+			u[i] = a[i] * b[(i + r) & (n - 1)] * a[(i + 1) & (n - 1)] * b[i] * v[i];
+		}
+		sum += u[r & (n - 1)].y;
+	}
+	simdTime = clockSeconds() - start;
+	start = clockSeconds();
+	for (int r = 0; r < reps; r++) {
+		for (int i = 0; i < n; i++) {
+			mat4 m = scalarMultiply(scalarMultiply(scalarMultiply(a[i], b[(i + r) & (n - 1)]), a[(i + 1) & (n - 1)]), b[i]);
+			w[i] = scalarTransform(m, v[i]);
+		}
+		sum += w[r & (n - 1)].y;
+	}
+	scalarTime = clockSeconds() - start;
+	diff = 0.0f;
+	for (int i = 0; i < n; i++) {
+		diff = max(diff, vecDifference(u[i], w[i]));
+	}
+	printMathBench("chain of 4 + vec", simdTime, scalarTime, ops, diff);
+
+	printf("(Checksum %g)\n", sum);
+	alignedFree(a);
+	alignedFree(b);
+	alignedFree(c);
+	alignedFree(d);
+	alignedFree(v);
+	alignedFree(u);
+	alignedFree(w);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,150 @@
+// One vertex and index buffer shared by every mesh (mesharena.h)
+
+// Each mesh's vertices and indices are appended to a shared arena, and the mesh is drawn
+// with a base vertex and first index into it.  Since every mesh uses the same buffers and
+// vertex format, one VAO serves them all, and draws for different meshes can be combined
+// into one glMultiDrawElementsIndirect call (see multidraw.h).
+//
+// The VAO also has an instance index attribute with a divisor of 1, reading 0, 1, 2, ...
+// from a fixed buffer.  Instance k of a draw with base instance b reads b + k, which the
+// vertex shader uses to find the instance's ObjectData.
+
+#include <stddef.h>  // offsetof
+
+typedef struct {
+	GLfloat position[3];
+	GLfloat texCoord[2];
+	GLfloat normal[3];
+	GLint boneIDs[4];
+	GLfloat boneWeights[4];
+} ArenaVertex;
+
+typedef struct {
+	GLint baseVertex;
+	GLuint firstIndex, indexCount;
+} MeshRange;
+
+// Attribute locations in the shader program.
+typedef struct {
+	GLuint position, texCoord, normal, boneIDs, boneWeights, instance;
+} ArenaAttribs;
+
+typedef struct {
+	GLuint vao;
+	GLuint vertexBuffer, indexBuffer, instanceBuffer;
+	GLsizeiptr vertexCapacity, indexCapacity;  // In vertices and indices.
+	GLsizeiptr vertexCount, indexCount;
+	ArenaAttribs attribs;
+} MeshArena;
+
+// Point the VAO's attributes at the current vertex buffer.
+static void arenaSetAttribs(MeshArena *a) {
+	glBindVertexArray(a->vao); CheckError();
+	glBindBuffer(GL_ARRAY_BUFFER, a->vertexBuffer); CheckError();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, a->indexBuffer); CheckError();
+
+	GLsizei stride = sizeof(ArenaVertex);
+	glVertexAttribPointer(a->attribs.position, 3, GL_FLOAT, GL_FALSE, stride,
+			BUFFER_OFFSET(offsetof(ArenaVertex, position))); CheckError();
+	glEnableVertexAttribArray(a->attribs.position); CheckError();
+	glVertexAttribPointer(a->attribs.texCoord, 2, GL_FLOAT, GL_FALSE, stride,
+			BUFFER_OFFSET(offsetof(ArenaVertex, texCoord))); CheckError();
+	glEnableVertexAttribArray(a->attribs.texCoord); CheckError();
+	glVertexAttribPointer(a->attribs.normal, 3, GL_FLOAT, GL_FALSE, stride,
+			BUFFER_OFFSET(offsetof(ArenaVertex, normal))); CheckError();
+	glEnableVertexAttribArray(a->attribs.normal); CheckError();
+	glVertexAttribIPointer(a->attribs.boneIDs, 4, GL_INT, stride,
+			BUFFER_OFFSET(offsetof(ArenaVertex, boneIDs))); CheckError();
+	glEnableVertexAttribArray(a->attribs.boneIDs); CheckError();
+	glVertexAttribPointer(a->attribs.boneWeights, 4, GL_FLOAT, GL_FALSE, stride,
+			BUFFER_OFFSET(offsetof(ArenaVertex, boneWeights))); CheckError();
+	glEnableVertexAttribArray(a->attribs.boneWeights); CheckError();
+}
+
+void arenaInit(MeshArena *a, const ArenaAttribs &attribs, GLsizeiptr vertexCapacity, GLsizeiptr indexCapacity) {
+	a->attribs = attribs;
+	a->vertexCapacity = vertexCapacity;
+	a->indexCapacity = indexCapacity;
+	a->vertexCount = a->indexCount = 0;
+
+	glGenVertexArrays(1, &a->vao); CheckError();
+	glGenBuffers(1, &a->vertexBuffer); CheckError();
+	glGenBuffers(1, &a->indexBuffer); CheckError();
+	glBindBuffer(GL_ARRAY_BUFFER, a->vertexBuffer); CheckError();
+	glBufferData(GL_ARRAY_BUFFER, sizeof(ArenaVertex) * vertexCapacity, NULL, GL_STATIC_DRAW); CheckError();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, a->indexBuffer); CheckError();
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indexCapacity, NULL, GL_STATIC_DRAW); CheckError();
+	arenaSetAttribs(a);
+
+	// The instance index: 0, 1, 2, ... advancing once per instance.
+	GLuint instances[maxInstancesPerDraw];
+	for (int i = 0; i < maxInstancesPerDraw; i++) {
+		instances[i] = i;
+	}
+	glGenBuffers(1, &a->instanceBuffer); CheckError();
+	glBindBuffer(GL_ARRAY_BUFFER, a->instanceBuffer); CheckError();
+	glBufferData(GL_ARRAY_BUFFER, sizeof(instances), instances, GL_STATIC_DRAW); CheckError();
+	glVertexAttribIPointer(a->attribs.instance, 1, GL_UNSIGNED_INT, 0, BUFFER_OFFSET(0)); CheckError();
+	glEnableVertexAttribArray(a->attribs.instance); CheckError();
+	if (glVertexAttribDivisor != NULL) {
+		glVertexAttribDivisor(a->attribs.instance, 1); CheckError();
+	} else {
+		glVertexAttribDivisorARB(a->attribs.instance, 1); CheckError();  // Before OpenGL 3.3
+	}
+
+	glBindVertexArray(0); CheckError();
+}
+
+// Replace a buffer with a bigger one holding the same data.
+static GLuint arenaGrowBuffer(GLuint buffer, GLsizeiptr usedBytes, GLsizeiptr newBytes) {
+	GLuint bigger;
+	glGenBuffers(1, &bigger); CheckError();
+	glBindBuffer(GL_COPY_WRITE_BUFFER, bigger); CheckError();
+	glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW); CheckError();
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer); CheckError();
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes); CheckError();
+	glDeleteBuffers(1, &buffer); CheckError();
+	return bigger;
+}
+
+// Append a mesh, returning where it is in the arena.  Indices are relative to the mesh's
+// first vertex.  This leaves the arena's VAO bound.
+MeshRange arenaAddMesh(MeshArena *a, const ArenaVertex *vertices, int nVertices, const GLuint *indices, int nIndices) {
+	bool grown = false;
+	if (a->vertexCount + nVertices > a->vertexCapacity) {
+		GLsizeiptr capacity = a->vertexCapacity;
+		while (a->vertexCount + nVertices > capacity) capacity *= 2;
+		a->vertexBuffer = arenaGrowBuffer(a->vertexBuffer, sizeof(ArenaVertex) * a->vertexCount,
+				sizeof(ArenaVertex) * capacity);
+		a->vertexCapacity = capacity;
+		grown = true;
+	}
+	if (a->indexCount + nIndices > a->indexCapacity) {
+		GLsizeiptr capacity = a->indexCapacity;
+		while (a->indexCount + nIndices > capacity) capacity *= 2;
+		a->indexBuffer = arenaGrowBuffer(a->indexBuffer, sizeof(GLuint) * a->indexCount,
+				sizeof(GLuint) * capacity);
+		a->indexCapacity = capacity;
+		grown = true;
+	}
+	if (grown) {
+		arenaSetAttribs(a);
+	} else {
+		glBindVertexArray(a->vao); CheckError();
+	}
+
+	MeshRange range;
+	range.baseVertex = a->vertexCount;
+	range.firstIndex = a->indexCount;
+	range.indexCount = nIndices;
+
+	glBindBuffer(GL_ARRAY_BUFFER, a->vertexBuffer); CheckError();
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(ArenaVertex) * a->vertexCount, sizeof(ArenaVertex) * nVertices,
+			vertices); CheckError();
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * a->indexCount, sizeof(GLuint) * nIndices,
+			indices); CheckError();
+
+	a->vertexCount += nVertices;
+	a->indexCount += nIndices;
+	return range;
+}
@@ -0,0 +1,91 @@
+// Drawing groups of batches with glMultiDrawElementsIndirect (multidraw.h)
+
+// Batches are collected into groups that can be drawn together: batches with the same
+// shader variant (influence level) and texture, whose ObjectData records fit in one
+// ObjectBlock.  Each batch is one DrawElementsIndirectCommand, with its base instance
+// giving the position of its first record in the group's block.  The commands are written to a ring buffer bound to
+// GL_DRAW_INDIRECT_BUFFER, and each group is drawn with one glMultiDrawElementsIndirect.
+//
+// Without OpenGL 4.3 (or ARB_multi_draw_indirect and ARB_base_instance), or with
+// --no-multidraw, each group is a single batch drawn with glDrawElementsInstancedBaseVertex.
+
+bool multiDraw = false;  // Set by initMultiDraw
+
+// The layout glMultiDrawElementsIndirect reads.
+typedef struct {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+} DrawElementsIndirectCommand;
+
+typedef struct {
+	int firstBatch, nBatches;
+	int level, texId;  // The influence level of the shader variant (see shadervariants.h)
+	int instances;  // ObjectData records used in the group's block.
+	bool joinable;  // Further batches can be added.
+	float nearDepth;  // Of the nearest object, for drawing groups front to back.
+	GLintptr objectOffset;  // Where the group's ObjectData records are in the uniform ring.
+	GLintptr commandOffset;  // Where the group's commands are in the indirect ring.
+} DrawGroup;
+
+DrawGroup *groups = NULL;
+int nGroups = 0, groupCapacity = 0;
+
+void initMultiDraw(bool allowed) {
+	multiDraw = allowed && glMultiDrawElementsIndirect != NULL
+			&& (HasGLVersion(4, 3) || (HasGLExtension("GL_ARB_multi_draw_indirect")
+					&& HasGLExtension("GL_ARB_base_instance")));
+	printf("Submitting draws with %s\n", multiDraw ? "glMultiDrawElementsIndirect" : "one call per batch");
+}
+
+void resetGroups() {
+	nGroups = 0;
+}
+
+// Add a batch (the next one in the batches array) to the last group if it can go there,
+// or start a new group.  level is the batch's influence level, and joinable says whether it
+// can share a draw with others.
+DrawGroup *groupBatch(int b, int level, bool joinable) {
+	DrawBatch *batch = &batches[b];
+	if (nGroups > 0) {
+		DrawGroup *last = &groups[nGroups - 1];
+		if (multiDraw && joinable && last->joinable && last->level == level && last->texId == batch->texId
+				&& last->instances + batch->count <= maxInstancesPerDraw) {
+			batch->baseInstance = last->instances;
+			last->instances += batch->count;
+			last->nBatches++;
+			return last;
+		}
+	}
+
+	if (nGroups == groupCapacity) {
+		groupCapacity = max(64, groupCapacity * 2);
+		groups = (DrawGroup*) realloc(groups, sizeof(DrawGroup) * groupCapacity);
+		if (groups == NULL) {
+			failInt("Error - out of memory for draw groups:", groupCapacity);
+		}
+	}
+
+	DrawGroup *g = &groups[nGroups++];
+	g->firstBatch = b;
+	g->nBatches = 1;
+	g->level = level;
+	g->texId = batch->texId;
+	g->instances = batch->count;
+	g->joinable = joinable;
+	g->nearDepth = keyMaxDepth;
+	g->objectOffset = g->commandOffset = 0;
+	batch->baseInstance = 0;
+	return g;
+}
+
+void setIndirectCommand(DrawElementsIndirectCommand *cmd, const MeshRange &range, int instanceCount,
+		int baseInstance) {
+	cmd->count = range.indexCount;
+	cmd->instanceCount = instanceCount;
+	cmd->firstIndex = range.firstIndex;
+	cmd->baseVertex = range.baseVertex;
+	cmd->baseInstance = baseInstance;
+}
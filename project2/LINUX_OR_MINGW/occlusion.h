@@ -0,0 +1,109 @@
+// Occlusion culling with hardware queries (occlusion.h)
+
+// When occlusion culling is on (the 'o' key, or --occlusion on the command line) each
+// object's bounding box is drawn, with colour and depth writes off, inside a
+// GL_SAMPLES_PASSED query.  Results are read the next frame, and only once they're
+// available, so the CPU never waits for the GPU.
+//   - Objects that were visible last frame are drawn as usual, then queried after the
+//     frame's draws to find out whether they've become hidden.
+//   - Objects that were hidden last frame (candidates) are queried before they're drawn,
+//     against the depth of everything else, and drawn inside glBeginConditionalRender so
+//     the GPU skips them if no samples passed.  Their result says whether they're back.
+// An object is always drawn if its box crosses the near plane, since the box could be clipped.
+
+bool occlusionCulling = false;
+
+typedef struct {
+	GLuint query;
+	bool pending;  // Issued, but the result hasn't been read yet.
+	bool guardsDraw;  // The pending query was used for a conditional draw.
+	bool occluded;  // No samples passed in the last result read.
+} OcclusionState;
+
+GLuint boxProgram;
+GLuint boxVAO;
+UniformMat4 boxTransform;
+
+void initOcclusion() {
+	boxProgram = InitShader("boxvshader.glsl", "boxfshader.glsl");
+	boxTransform.init(boxProgram, "BoxTransform");
+
+	// A unit cube, drawn as 12 triangles.
+	static const GLfloat corners[8][3] = {
+		{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {1, 1, 0}, {0, 0, 1}, {1, 0, 1}, {0, 1, 1}, {1, 1, 1}
+	};
+	static const GLubyte faces[36] = {
+		0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,  0, 1, 4,  1, 5, 4,
+		2, 6, 3,  3, 6, 7,  0, 4, 2,  2, 4, 6,  1, 3, 5,  3, 7, 5
+	};
+
+	glGenVertexArrays(1, &boxVAO); CheckError();
+	glBindVertexArray(boxVAO); CheckError();
+
+	GLuint buffers[2];
+	glGenBuffers(2, buffers); CheckError();
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]); CheckError();
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW); CheckError();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]); CheckError();
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW); CheckError();
+
+	GLuint boxPosition = attribLocation(boxProgram, "vPosition");
+	glVertexAttribPointer(boxPosition, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0)); CheckError();
+	glEnableVertexAttribArray(boxPosition); CheckError();
+	glBindVertexArray(0); CheckError();
+}
+
+// Read an object's query result if it's ready.  triangles is for the stats, if the
+// query guarded a draw that the GPU skipped.
+void readOcclusionResult(OcclusionState *s, int triangles) {
+	if (!s->pending) return;
+
+	GLuint available = 0;
+	glGetQueryObjectuiv(s->query, GL_QUERY_RESULT_AVAILABLE, &available); CheckError();
+	if (!available) return;
+
+	GLuint samples = 0;
+	glGetQueryObjectuiv(s->query, GL_QUERY_RESULT, &samples); CheckError();
+	s->occluded = (samples == 0);
+	s->pending = false;
+	if (s->guardsDraw && s->occluded) {
+		frameStats.objectsOccluded++;
+		frameStats.trianglesOccluded += triangles;
+	}
+}
+
+// Set up for drawing boxes: the box program and VAO, with colour and depth writes off.
+void beginOcclusionBoxes() {
+	useProgram(boxProgram);
+	bindVertexArray(boxVAO);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE); CheckError();
+	glDepthMask(GL_FALSE); CheckError();
+}
+
+void endOcclusionBoxes() {
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE); CheckError();
+	glDepthMask(GL_TRUE); CheckError();
+}
+
+// Query a box (in model coordinates), given the object's model-view-projection matrix.
+void queryOcclusionBox(OcclusionState *s, const mat4 &modelViewProjection, const vec3 &boxMin,
+		const vec3 &boxMax, bool guardsDraw) {
+	if (s->query == 0) {
+		glGenQueries(1, &s->query); CheckError();
+	}
+
+	boxTransform.set(modelViewProjection * Translate(boxMin) * Scale(boxMax - boxMin));
+	glBeginQuery(GL_SAMPLES_PASSED, s->query); CheckError();
+	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, NULL); CheckError();
+	glEndQuery(GL_SAMPLES_PASSED); CheckError();
+
+	s->pending = true;
+	s->guardsDraw = guardsDraw;
+	frameStats.occlusionQueries++;
+}
+
+// True if a sphere (in eye coordinates) reaches the near side of the near plane.
+bool crossesNearPlane(const FrustumPlanes *f, const CullSpheres *s, int i) {
+	const float *pl = f->plane[4];
+	return pl[0] * s->x[i] + pl[1] * s->y[i] + pl[2] * s->z[i] + pl[3] < s->r[i];
+}
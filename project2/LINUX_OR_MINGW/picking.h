@@ -0,0 +1,324 @@
+// Ray-cast picking with bounding volume hierarchies (picking.h)
+
+// Ctrl+clicking selects the object under the mouse: a ray is cast from the mouse through
+// the inverse of projection * view, and the nearest triangle it hits decides the object.
+// There are two levels of bounding volume tree (binary trees of axis-aligned boxes):
+//   - The dynamic tree over the objects' world space boxes, kept up to date as objects
+//     move (see aabbtree.h).
+//   - A BVH over each mesh's triangles, in model coordinates, built when the mesh is loaded.
+//     For a mesh with bones, the vertices are posed as the picked object is posed this
+//     frame and the tree is refit to them.
+// The ray is moved into each object's model coordinates rather than moving its triangles.
+
+const int bvhLeafSize = 4;  // The most items in a leaf
+const int bvhMaxDepth = 64;  // Limits the traversal stack (see bvhBuildNode)
+
+typedef struct {
+	vec3 origin, dir;
+	vec3 invDir;  // 1 / dir, for the box tests
+} Ray;
+
+// The nodes are stored depth first: an inner node's left child is the next node.
+typedef struct {
+	vec3 boxMin, boxMax;
+	int first;  // Leaf: the first of its items in BVH::items; inner: the right child.
+	int count;  // Leaf: the number of items; inner: 0.
+} BVHNode;
+
+typedef struct {
+	BVHNode *nodes;
+	int nNodes;
+	int *items;  // Item numbers, in the order the leaves refer to them.
+	int nItems;
+} BVH;
+
+Ray makeRay(const vec3 &origin, const vec3 &dir) {
+	Ray r;
+	r.origin = origin;
+	r.dir = dir;
+	for (int c = 0; c < 3; c++) {
+		r.invDir[c] = 1.0f / (dir[c] != 0.0f ? dir[c] : 1e-30f);
+	}
+	return r;
+}
+
+// Where a ray enters a box, or tMax if it misses or enters at or after tMax.
+static inline float rayBoxEntry(const Ray &r, const vec3 &boxMin, const vec3 &boxMax, float tMax) {
+	float tNear = 0.0f, tFar = tMax;
+	for (int c = 0; c < 3; c++) {
+		float t0 = (boxMin[c] - r.origin[c]) * r.invDir[c];
+		float t1 = (boxMax[c] - r.origin[c]) * r.invDir[c];
+		tNear = max(tNear, min(t0, t1));
+		tFar = min(tFar, max(t0, t1));
+	}
+	return tNear <= tFar ? tNear : tMax;
+}
+
+// Where a ray hits a triangle (Moller-Trumbore), or tMax if it misses or hits at or after tMax.
+static inline float rayTriangle(const Ray &r, const vec3 &a, const vec3 &b, const vec3 &c, float tMax) {
+	vec3 e1 = b - a, e2 = c - a;
+	vec3 p = cross(r.dir, e2);
+	float det = dot(e1, p);
+	if (fabs(det) < 1e-12f) return tMax;  // Parallel
+	float inv = 1.0f / det;
+	vec3 s = r.origin - a;
+	float u = dot(s, p) * inv;
+	if (u < 0.0f || u > 1.0f) return tMax;
+	vec3 q = cross(s, e1);
+	float v = dot(r.dir, q) * inv;
+	if (v < 0.0f || u + v > 1.0f) return tMax;
+	float t = dot(e2, q) * inv;
+	return (t > 0.0f && t < tMax) ? t : tMax;
+}
+
+// ---- [Building and refitting] -----------------------------------------------
+
+static void bvhBoundItems(const BVH *bvh, const vec3 *itemMin, const vec3 *itemMax, int first, int count,
+		vec3 *boxMin, vec3 *boxMax) {
+	*boxMin = vec3(1e30f, 1e30f, 1e30f);
+	*boxMax = vec3(-1e30f, -1e30f, -1e30f);
+	for (int k = first; k < first + count; k++) {
+		int item = bvh->items[k];
+		for (int c = 0; c < 3; c++) {
+			(*boxMin)[c] = min((*boxMin)[c], itemMin[item][c]);
+			(*boxMax)[c] = max((*boxMax)[c], itemMax[item][c]);
+		}
+	}
+}
+
+// Split items [first, first + count) at the middle of their centres' longest extent.  Past
+// half of bvhMaxDepth (or when every centre is in the same place) they're split at the
+// middle item instead, which halves the count, so no path is longer than bvhMaxDepth.
+static int bvhBuildNode(BVH *bvh, const vec3 *itemMin, const vec3 *itemMax, int first, int count, int depth) {
+	int n = bvh->nNodes++;
+	bvhBoundItems(bvh, itemMin, itemMax, first, count, &bvh->nodes[n].boxMin, &bvh->nodes[n].boxMax);
+	if (count <= bvhLeafSize) {
+		bvh->nodes[n].first = first;
+		bvh->nodes[n].count = count;
+		return n;
+	}
+
+	vec3 lo(1e30f, 1e30f, 1e30f), hi(-1e30f, -1e30f, -1e30f);
+	for (int k = first; k < first + count; k++) {
+		int item = bvh->items[k];
+		for (int c = 0; c < 3; c++) {
+			float centre = itemMin[item][c] + itemMax[item][c];  // Twice the centre
+			lo[c] = min(lo[c], centre);
+			hi[c] = max(hi[c], centre);
+		}
+	}
+	int axis = 0;
+	for (int c = 1; c < 3; c++) {
+		if (hi[c] - lo[c] > hi[axis] - lo[axis]) axis = c;
+	}
+	float mid = (lo[axis] + hi[axis]) * 0.5f;
+
+	int split = first;
+	for (int k = first; k < first + count; k++) {
+		int item = bvh->items[k];
+		if (itemMin[item][axis] + itemMax[item][axis] < mid) {
+			bvh->items[k] = bvh->items[split];
+			bvh->items[split++] = item;
+		}
+	}
+	if (depth >= bvhMaxDepth / 2 || split == first || split == first + count) {
+		split = first + count / 2;
+	}
+
+	bvhBuildNode(bvh, itemMin, itemMax, first, split - first, depth + 1);
+	int right = bvhBuildNode(bvh, itemMin, itemMax, split, first + count - split, depth + 1);
+	bvh->nodes[n].first = right;
+	bvh->nodes[n].count = 0;
+	return n;
+}
+
+// Build a BVH over n items, given each item's box.
+void bvhBuild(BVH *bvh, const vec3 *itemMin, const vec3 *itemMax, int n) {
+	free(bvh->nodes);
+	free(bvh->items);
+	bvh->nodes = (BVHNode*) malloc(sizeof(BVHNode) * max(1, 2 * n));
+	bvh->items = (int*) malloc(sizeof(int) * max(1, n));
+	if (bvh->nodes == NULL || bvh->items == NULL) {
+		failInt("Error - out of memory for a BVH over items:", n);
+	}
+	for (int k = 0; k < n; k++) {
+		bvh->items[k] = k;
+	}
+	bvh->nItems = n;
+	bvh->nNodes = 0;
+	if (n > 0) {
+		bvhBuildNode(bvh, itemMin, itemMax, 0, n, 0);
+	}
+}
+
+// Recompute every node's box from the items' new boxes, keeping the tree.  Children come
+// after their parents, so going backwards visits them first.
+void bvhRefit(BVH *bvh, const vec3 *itemMin, const vec3 *itemMax) {
+	for (int n = bvh->nNodes - 1; n >= 0; n--) {
+		BVHNode *node = &bvh->nodes[n];
+		if (node->count > 0) {
+			bvhBoundItems(bvh, itemMin, itemMax, node->first, node->count, &node->boxMin, &node->boxMax);
+		} else {
+			const BVHNode *left = &bvh->nodes[n + 1], *right = &bvh->nodes[node->first];
+			for (int c = 0; c < 3; c++) {
+				node->boxMin[c] = min(left->boxMin[c], right->boxMin[c]);
+				node->boxMax[c] = max(left->boxMax[c], right->boxMax[c]);
+			}
+		}
+	}
+}
+
+// ---- [Ray casting] ----------------------------------------------------------
+
+// Find the nearest item a ray hits before tMax.  hitItem returns where along the ray an item
+// is hit, or the tMax it's given if it's missed.  Nearer children are visited first, and
+// nodes the ray enters beyond the nearest hit so far are skipped.  Returns the item, or -1.
+int bvhRayCast(const BVH *bvh, const Ray &ray, float *tMax,
+		float (*hitItem)(void *context, int item, const Ray &ray, float tMax), void *context) {
+	int nearest = -1;
+	if (bvh->nNodes == 0 || rayBoxEntry(ray, bvh->nodes[0].boxMin, bvh->nodes[0].boxMax, *tMax) >= *tMax) {
+		return nearest;
+	}
+
+	int stack[bvhMaxDepth];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const BVHNode *node = &bvh->nodes[stack[--top]];
+		if (node->count > 0) {
+			for (int k = node->first; k < node->first + node->count; k++) {
+				float t = hitItem(context, bvh->items[k], ray, *tMax);
+				if (t < *tMax) {
+					*tMax = t;
+					nearest = bvh->items[k];
+				}
+			}
+			continue;
+		}
+
+		int a = node - bvh->nodes + 1, b = node->first;
+		float ta = rayBoxEntry(ray, bvh->nodes[a].boxMin, bvh->nodes[a].boxMax, *tMax);
+		float tb = rayBoxEntry(ray, bvh->nodes[b].boxMin, bvh->nodes[b].boxMax, *tMax);
+		if (tb < ta) {
+			int n = a; a = b; b = n;
+			float t = ta; ta = tb; tb = t;
+		}
+		if (tb < *tMax) stack[top++] = b;  // Pushed first, so visited after a
+		if (ta < *tMax) stack[top++] = a;
+	}
+	return nearest;
+}
+
+// ---- [Mesh triangles] -------------------------------------------------------
+
+typedef struct {
+	BVH bvh;
+	int nVerts, nTris;
+	GLuint *indices;  // Three per triangle
+	vec3 *rest;  // Vertex positions, in model coordinates
+	vec3 *posed;  // For meshes with bones, the vertices in the pose last picked; otherwise rest.
+	float posedTime;  // The pose time posed is for (-1 before the first)
+	GLint (*boneIDs)[4];  // NULL for meshes without bones
+	GLfloat (*boneWeights)[4];
+	vec3 *triMin, *triMax;  // Each triangle's box, for refitting to a pose
+} MeshTriangles;
+
+static void triangleBoxes(MeshTriangles *m, const vec3 *verts) {
+	for (int t = 0; t < m->nTris; t++) {
+		const vec3 &a = verts[m->indices[3*t]], &b = verts[m->indices[3*t + 1]], &c = verts[m->indices[3*t + 2]];
+		for (int k = 0; k < 3; k++) {
+			m->triMin[t][k] = min(a[k], min(b[k], c[k]));
+			m->triMax[t][k] = max(a[k], max(b[k], c[k]));
+		}
+	}
+}
+
+// Build a mesh's triangle BVH, over its rest pose.  boneIDs and boneWeights are only kept
+// if the mesh has bones.
+void buildMeshTriangles(MeshTriangles *m, aiMesh *mesh, GLint boneIDs[][4], GLfloat boneWeights[][4]) {
+	m->nVerts = mesh->mNumVertices;
+	m->nTris = mesh->mNumFaces;
+	m->indices = new GLuint[3 * m->nTris];
+	m->rest = new vec3[m->nVerts];
+	for (int v = 0; v < m->nVerts; v++) {
+		const aiVector3D &p = mesh->mVertices[v];
+		m->rest[v] = vec3(p.x, p.y, p.z);
+	}
+	for (int t = 0; t < m->nTris; t++) {
+		for (int k = 0; k < 3; k++) {
+			m->indices[3*t + k] = mesh->mFaces[t].mIndices[k];
+		}
+	}
+
+	m->triMin = new vec3[m->nTris];
+	m->triMax = new vec3[m->nTris];
+	triangleBoxes(m, m->rest);
+	bvhBuild(&m->bvh, m->triMin, m->triMax, m->nTris);
+
+	m->posed = m->rest;
+	m->posedTime = -1.0f;
+	if (mesh->mNumBones > 0) {
+		m->posed = new vec3[m->nVerts];
+		m->boneIDs = new GLint[m->nVerts][4];
+		m->boneWeights = new GLfloat[m->nVerts][4];
+		memcpy(m->boneIDs, boneIDs, sizeof(GLint) * 4 * m->nVerts);
+		memcpy(m->boneWeights, boneWeights, sizeof(GLfloat) * 4 * m->nVerts);
+	} else {
+		m->boneIDs = NULL;
+		m->boneWeights = NULL;
+		delete [] m->triMin;
+		delete [] m->triMax;
+		m->triMin = m->triMax = NULL;
+	}
+}
+
+// Move a mesh with bones into a pose, given its bone transforms, and refit its BVH.
+void poseMeshTriangles(MeshTriangles *m, const mat4 *boneTransforms, float poseTime) {
+	if (m->boneIDs == NULL || poseTime == m->posedTime) return;
+	for (int v = 0; v < m->nVerts; v++) {
+		vec4 rest(m->rest[v], 1.0), posed(0.0, 0.0, 0.0, 0.0);
+		for (int k = 0; k < 4; k++) {
+			posed += m->boneWeights[v][k] * (boneTransforms[m->boneIDs[v][k]] * rest);
+		}
+		m->posed[v] = vec3(posed.x, posed.y, posed.z);
+	}
+	triangleBoxes(m, m->posed);
+	bvhRefit(&m->bvh, m->triMin, m->triMax);
+	m->posedTime = poseTime;
+}
+
+static float hitMeshTriangle(void *context, int t, const Ray &ray, float tMax) {
+	const MeshTriangles *m = (const MeshTriangles*) context;
+	const GLuint *tri = &m->indices[3*t];
+	return rayTriangle(ray, m->posed[tri[0]], m->posed[tri[1]], m->posed[tri[2]], tMax);
+}
+
+// Where a ray (in model coordinates) first hits a mesh, or tMax if it doesn't before then.
+float rayCastMesh(MeshTriangles *m, const Ray &ray, float tMax) {
+	bvhRayCast(&m->bvh, ray, &tMax, hitMeshTriangle, m);
+	return tMax;
+}
+
+// ---- [Object boxes] ---------------------------------------------------------
+
+// The world space box around a model space box, moved by a matrix: the centre moves, and
+// each half-extent is summed through the absolute values of the matrix.
+void transformBox(const mat4 &m, const vec3 &boxMin, const vec3 &boxMax, vec3 *outMin, vec3 *outMax) {
+	vec3 centre = (boxMin + boxMax) * 0.5, half = (boxMax - boxMin) * 0.5;
+	for (int r = 0; r < 3; r++) {
+		float c = m[r][3] + m[r][0] * centre.x + m[r][1] * centre.y + m[r][2] * centre.z;
+		float h = fabs(m[r][0]) * half.x + fabs(m[r][1]) * half.y + fabs(m[r][2]) * half.z;
+		(*outMin)[r] = c - h;
+		(*outMax)[r] = c + h;
+	}
+}
+
+// The world space ray under a point in the window, through the inverse of projection * view.
+Ray mouseRay(const mat4 &projection, const mat4 &view, int x, int y, int width, int height) {
+	mat4 unproject = inverse(projection * view);
+	float nx = 2.0f * (x + 0.5f) / width - 1.0f, ny = 1.0f - 2.0f * (y + 0.5f) / height;
+	vec4 nearPoint = unproject * vec4(nx, ny, -1.0, 1.0), farPoint = unproject * vec4(nx, ny, 1.0, 1.0);
+	vec3 from = vec3(nearPoint.x, nearPoint.y, nearPoint.z) / nearPoint.w;
+	vec3 to = vec3(farPoint.x, farPoint.y, farPoint.z) / farPoint.w;
+	return makeRay(from, to - from);
+}
@@ -0,0 +1,108 @@
+// Writing images as uncompressed PNG files (pngwrite.h)
+
+// The image data is stored in a zlib stream without compression (stored deflate blocks),
+// so no compression library is needed.  The files are larger, but any viewer reads them.
+
+static uint32_t pngCRCTable[256];
+
+static uint32_t pngCRC(uint32_t crc, const unsigned char *data, size_t len) {
+	if (pngCRCTable[1] == 0) {
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++) {
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			pngCRCTable[n] = c;
+		}
+	}
+	for (size_t i = 0; i < len; i++) {
+		crc = pngCRCTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+static void pngPut32(unsigned char *p, uint32_t v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void pngWriteChunk(FILE *file, const char *type, const unsigned char *data, uint32_t len) {
+	unsigned char word[4];
+	pngPut32(word, len);
+	fwrite(word, 1, 4, file);
+	fwrite(type, 1, 4, file);
+	fwrite(data, 1, len, file);
+
+	uint32_t crc = pngCRC(0xffffffffu, (const unsigned char*) type, 4);
+	crc = pngCRC(crc, data, len) ^ 0xffffffffu;
+	pngPut32(word, crc);
+	fwrite(word, 1, 4, file);
+}
+
+// Write an RGB image whose rows are stored bottom to top (as glReadPixels returns them).
+bool writePNG(const char *fileName, int width, int height, const unsigned char *rgb) {
+	FILE *file = fopen(fileName, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Error: Could not open '%s' for writing\n", fileName);
+		return false;
+	}
+
+	static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+	fwrite(signature, 1, 8, file);
+
+	unsigned char header[13];
+	pngPut32(header, width);
+	pngPut32(header + 4, height);
+	header[8] = 8;  // Bits per channel
+	header[9] = 2;  // RGB
+	header[10] = header[11] = header[12] = 0;  // Deflate, standard filters, not interlaced
+	pngWriteChunk(file, "IHDR", header, 13);
+
+	// The raw image: each row (top to bottom) is a filter type byte (0, none) then its pixels.
+	size_t rowBytes = (size_t) width * 3 + 1;
+	size_t rawSize = rowBytes * height;
+	size_t nBlocks = (rawSize + 65534) / 65535;
+	unsigned char *raw = (unsigned char*) malloc(rawSize);
+	unsigned char *idat = (unsigned char*) malloc(2 + rawSize + 5 * nBlocks + 4);
+	if (raw == NULL || idat == NULL) {
+		failInt("Error - out of memory for a PNG image, bytes:", (int) rawSize);
+	}
+	for (int y = 0; y < height; y++) {
+		unsigned char *row = raw + rowBytes * y;
+		row[0] = 0;
+		memcpy(row + 1, rgb + (size_t) width * 3 * (height - 1 - y), (size_t) width * 3);
+	}
+
+	// A zlib stream of stored blocks, then the Adler-32 checksum of the raw data.
+	unsigned char *p = idat;
+	*p++ = 0x78;
+	*p++ = 0x01;
+	uint32_t a = 1, b = 0;
+	for (size_t done = 0; done < rawSize; ) {
+		size_t len = min(rawSize - done, (size_t) 65535);
+		*p++ = (done + len == rawSize) ? 1 : 0;  // Last block flag, and type 0 (stored)
+		*p++ = len & 0xff;
+		*p++ = len >> 8;
+		*p++ = ~len & 0xff;
+		*p++ = (~len >> 8) & 0xff;
+		memcpy(p, raw + done, len);
+		for (size_t i = 0; i < len; i++) {
+			a = (a + raw[done + i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		p += len;
+		done += len;
+	}
+	pngPut32(p, (b << 16) | a);
+	p += 4;
+
+	pngWriteChunk(file, "IDAT", idat, p - idat);
+	pngWriteChunk(file, "IEND", NULL, 0);
+
+	free(raw);
+	free(idat);
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,306 @@
+// Per-stage frame timing, with an overlay (profiler.h)
+
+// Each frame's CPU time is split between the stages below.  profileStage marks where the
+// frame moves on to the next stage, and a ProfileScope (e.g. around loading a mesh)
+// charges its time to its own stage then goes back to the stage it interrupted, so every
+// moment is counted once.  The GPU time of each frame is measured with a GL_TIME_ELAPSED
+// query.  There are two queries, used on alternate frames, and each is read just before
+// it's reused - two frames after it was issued, by which time the GPU has normally
+// finished with it.
+//
+// The last profileHistory frames are kept.  With the profiler on (the 'p' key, or
+// --profile on the command line) they're drawn over the scene: a stacked bar of the
+// stages for each frame, the GPU time of each frame, histograms of the CPU and GPU
+// times, and the average and worst time of each stage.  With --profile-csv FILE every
+// frame's times are also written to FILE.  Both show the frame-time governor's quality
+// level, when it's on (see governor.h).
+
+#define PROFILE_STAGES(X) \
+	X(Load, "load", 0.9f, 0.9f, 0.9f) \
+	X(Animation, "animation", 0.3f, 0.8f, 0.3f) \
+	X(Matrices, "matrices", 0.3f, 0.6f, 1.0f) \
+	X(Culling, "culling", 0.9f, 0.8f, 0.2f) \
+	X(Upload, "upload", 0.8f, 0.4f, 0.9f) \
+	X(Submit, "submit", 1.0f, 0.4f, 0.3f)
+
+enum {
+#define StageEnum(name, desc, r, g, b)  stage##name,
+	PROFILE_STAGES(StageEnum)
+#undef StageEnum
+	numProfileStages
+};
+
+const int profileHistory = 128;
+
+typedef struct {
+	float cpuMs[numProfileStages];
+	float gpuMs;  // -1 until the frame's query result has been read.
+	int quality;  // The governor's quality level (0 is full quality).
+} ProfileFrame;
+
+bool showProfile = false;  // Set by the 'p' key or --profile
+const char *profileCSVFile = NULL;  // Set by --profile-csv
+
+ProfileFrame profileFrames[profileHistory];  // Frame n is at n % profileHistory.
+int profileFrameNum = 0;  // The frame being profiled.
+int profileStageNow = -1;  // The stage time is being charged to, or -1 for none.
+double profileMark;  // When the current stage started (or resumed).
+
+bool gpuTiming = false;
+GLuint timeQueries[2];
+int timeQueryFrame[2] = { -1, -1 };  // The frame each query timed, or -1.
+FILE *profileCSV = NULL;
+char profileStatus[192] = "";  // A line for the overlay from the governor, if any
+
+GLuint hudProgram, hudVAO, hudBuffer;
+UniformMat4 hudProjection;
+
+// Charge the time since the last switch to the current stage, then change stage.
+static void profileSwitch(int stage) {
+	double now = clockSeconds();
+	if (profileStageNow >= 0) {
+		profileFrames[profileFrameNum % profileHistory].cpuMs[profileStageNow] += (now - profileMark) * 1000.0;
+	}
+	profileMark = now;
+	profileStageNow = stage;
+}
+
+// Move the frame on to another stage.
+void profileStage(int stage) {
+	profileSwitch(stage);
+}
+
+// Charges the time until the end of the scope to a stage, nested inside whatever stage
+// was running.
+struct ProfileScope {
+	int outer;
+
+	ProfileScope(int stage) {
+		outer = profileStageNow;
+		profileSwitch(stage);
+	}
+
+	~ProfileScope() {
+		profileSwitch(outer);
+	}
+};
+
+static float profileCPUTotal(const ProfileFrame *f) {
+	float total = 0.0f;
+	for (int s = 0; s < numProfileStages; s++) {
+		total += f->cpuMs[s];
+	}
+	return total;
+}
+
+static void writeProfileCSV(int frameNum) {
+	if (profileCSV == NULL) return;
+	const ProfileFrame *f = &profileFrames[frameNum % profileHistory];
+	fprintf(profileCSV, "%d", frameNum);
+	for (int s = 0; s < numProfileStages; s++) {
+		fprintf(profileCSV, ",%.4f", f->cpuMs[s]);
+	}
+	fprintf(profileCSV, ",%.4f,%.4f,%d\n", profileCPUTotal(f), f->gpuMs, f->quality);
+}
+
+void initProfiler() {
+	gpuTiming = HasGLVersion(3, 3) || HasGLExtension("GL_ARB_timer_query");
+	if (gpuTiming) {
+		glGenQueries(2, timeQueries); CheckError();
+	} else {
+		printf("Timer queries are not available, so the profiler only shows CPU times\n");
+	}
+
+	if (profileCSVFile != NULL) {
+		profileCSV = fopen(profileCSVFile, "w");
+		if (profileCSV == NULL) {
+			fprintf(stderr, "Error: Could not open '%s' for writing\n", profileCSVFile);
+			exit(EXIT_FAILURE);
+		}
+		fprintf(profileCSV, "frame");
+#define PrintStage(name, desc, r, g, b)  fprintf(profileCSV, ",%s_ms", desc);
+		PROFILE_STAGES(PrintStage)
+#undef PrintStage
+		fprintf(profileCSV, ",cpu_ms,gpu_ms,quality\n");
+	}
+
+	hudProgram = InitShader("hudvshader.glsl", "hudfshader.glsl");
+	hudProjection.init(hudProgram, "Projection");
+
+	glGenVertexArrays(1, &hudVAO); CheckError();
+	glBindVertexArray(hudVAO); CheckError();
+	glGenBuffers(1, &hudBuffer); CheckError();
+	glBindBuffer(GL_ARRAY_BUFFER, hudBuffer); CheckError();
+	GLuint hudPosition = attribLocation(hudProgram, "vPosition");
+	GLuint hudColor = attribLocation(hudProgram, "vColor");
+	glVertexAttribPointer(hudPosition, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), BUFFER_OFFSET(0)); CheckError();
+	glEnableVertexAttribArray(hudPosition); CheckError();
+	glVertexAttribPointer(hudColor, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat),
+			BUFFER_OFFSET(2 * sizeof(GLfloat))); CheckError();
+	glEnableVertexAttribArray(hudColor); CheckError();
+	glBindVertexArray(0); CheckError();
+}
+
+// Call at the start of a frame, before any GL commands.
+void beginProfileFrame() {
+	int slot = profileFrameNum % 2;
+	if (gpuTiming) {
+		int timed = timeQueryFrame[slot];
+		if (timed >= 0 && timed > profileFrameNum - profileHistory) {
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(timeQueries[slot], GL_QUERY_RESULT, &ns); CheckError();  // Waits if needed
+			profileFrames[timed % profileHistory].gpuMs = ns * 1e-6f;
+			writeProfileCSV(timed);
+		}
+		glBeginQuery(GL_TIME_ELAPSED, timeQueries[slot]); CheckError();
+	}
+
+	ProfileFrame *f = &profileFrames[profileFrameNum % profileHistory];
+	memset(f, 0, sizeof(ProfileFrame));
+	f->gpuMs = -1.0f;
+	profileMark = clockSeconds();
+}
+
+// Call after the frame's last GL command (before drawing the overlay).
+void endProfileFrame() {
+	profileSwitch(-1);
+	if (gpuTiming) {
+		glEndQuery(GL_TIME_ELAPSED); CheckError();
+		timeQueryFrame[profileFrameNum % 2] = profileFrameNum;
+	} else {
+		writeProfileCSV(profileFrameNum);
+	}
+	profileFrameNum++;
+}
+
+// ---- [Overlay] --------------------------------------------------------------
+
+// Coloured rectangles in window coordinates, drawn together, then text on top.
+const int maxHudRects = 2048;
+static GLfloat hudVertices[maxHudRects * 6][6];
+static int nHudVertices;
+
+static void hudRect(float x0, float y0, float x1, float y1, float r, float g, float b, float a) {
+	if (nHudVertices + 6 > maxHudRects * 6) return;
+	const float corners[6][2] = { {x0, y0}, {x1, y0}, {x1, y1}, {x0, y0}, {x1, y1}, {x0, y1} };
+	for (int v = 0; v < 6; v++) {
+		GLfloat *dst = hudVertices[nHudVertices++];
+		dst[0] = corners[v][0];
+		dst[1] = corners[v][1];
+		dst[2] = r;
+		dst[3] = g;
+		dst[4] = b;
+		dst[5] = a;
+	}
+}
+
+static void hudText(int x, int y, float r, float g, float b, const char *text) {
+	glColor3f(r, g, b);
+	glWindowPos2i(x, y);
+	for (const char *c = text; *c != '\0'; c++) {
+		glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+	}
+}
+
+// Draw the overlay over the current frame, for a window of the given size.
+void drawProfileHUD(int width, int height) {
+	const float pixelsPerMs = 4.0f;
+	const float graphHeight = 33.3f * pixelsPerMs;  // Two frames at 60 Hz
+	const int histogramBins = 34;  // 1 ms each, the last for anything longer
+	const float left = 10.0f, bottom = 10.0f;
+	const float graphWidth = profileHistory * 2.0f;
+	const float histLeft = left + graphWidth * 2.0f + 20.0f;
+
+	// Frames whose GPU time is known (the two latest aren't), oldest first.
+	int last = profileFrameNum - 1;
+	int first = max(0, profileFrameNum - profileHistory);
+
+	float avg[numProfileStages + 2] = { 0.0f }, worst[numProfileStages + 2] = { 0.0f };  // Stages, CPU, GPU
+	int cpuBins[histogramBins] = { 0 }, gpuBins[histogramBins] = { 0 };
+	int nFrames = 0, nGPUFrames = 0;
+
+	nHudVertices = 0;
+	hudRect(left - 5.0f, bottom - 5.0f, histLeft + histogramBins * 4.0f + 5.0f, bottom + graphHeight + 5.0f,
+			0.0f, 0.0f, 0.0f, 0.6f);
+	hudRect(left, bottom + 16.7f * pixelsPerMs, histLeft - 20.0f, bottom + 16.7f * pixelsPerMs + 1.0f,
+			0.5f, 0.5f, 0.5f, 1.0f);  // 60 Hz
+
+	for (int n = first; n <= last; n++) {
+		const ProfileFrame *f = &profileFrames[n % profileHistory];
+		float x = left + (n - first) * 2.0f;
+		float y = bottom;
+		for (int s = 0; s < numProfileStages; s++) {
+			static const float colors[numProfileStages][3] = {
+#define StageColor(name, desc, r, g, b)  { r, g, b },
+				PROFILE_STAGES(StageColor)
+#undef StageColor
+			};
+			float top = min(y + f->cpuMs[s] * pixelsPerMs, bottom + graphHeight);
+			hudRect(x, y, x + 2.0f, top, colors[s][0], colors[s][1], colors[s][2], 1.0f);
+			y = top;
+			avg[s] += f->cpuMs[s];
+			worst[s] = max(worst[s], f->cpuMs[s]);
+		}
+		float cpu = profileCPUTotal(f);
+		avg[numProfileStages] += cpu;
+		worst[numProfileStages] = max(worst[numProfileStages], cpu);
+		cpuBins[min((int) cpu, histogramBins - 1)]++;
+		nFrames++;
+
+		if (f->gpuMs >= 0.0f) {
+			float gx = left + graphWidth + (n - first) * 2.0f;
+			hudRect(gx, bottom, gx + 2.0f, bottom + min(f->gpuMs * pixelsPerMs, graphHeight), 1.0f, 0.6f, 0.1f, 1.0f);
+			avg[numProfileStages + 1] += f->gpuMs;
+			worst[numProfileStages + 1] = max(worst[numProfileStages + 1], f->gpuMs);
+			gpuBins[min((int) f->gpuMs, histogramBins - 1)]++;
+			nGPUFrames++;
+		}
+	}
+
+	// Histograms: CPU frame times up from the middle, GPU times down from it.
+	float mid = bottom + graphHeight / 2.0f;
+	for (int bin = 0; bin < histogramBins; bin++) {
+		float x = histLeft + bin * 4.0f;
+		hudRect(x, mid, x + 3.0f, mid + cpuBins[bin] * graphHeight / 2.0f / max(nFrames, 1), 0.9f, 0.9f, 0.9f, 1.0f);
+		hudRect(x, mid - gpuBins[bin] * graphHeight / 2.0f / max(nGPUFrames, 1), x + 3.0f, mid, 1.0f, 0.6f, 0.1f, 1.0f);
+	}
+
+	glDisable(GL_DEPTH_TEST); CheckError();
+	glEnable(GL_BLEND); CheckError();
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); CheckError();
+
+	useProgram(hudProgram);
+	bindVertexArray(hudVAO);
+	hudProjection.set(Ortho(0.0, width, 0.0, height, -1.0, 1.0));
+	glBindBuffer(GL_ARRAY_BUFFER, hudBuffer); CheckError();
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * nHudVertices, hudVertices, GL_STREAM_DRAW); CheckError();
+	glDrawArrays(GL_TRIANGLES, 0, nHudVertices); CheckError();
+
+	// The text is drawn with GLUT's bitmap fonts, which need the fixed-function pipeline.
+	useProgram(0);
+	char line[128];
+	int y = (int) (bottom + graphHeight) + 20;
+	int s = 0;
+#define StageText(name, desc, r, g, b) \
+	sprintf(line, "%-10s %6.2f ms avg %6.2f ms max", desc, avg[s] / max(nFrames, 1), worst[s]); \
+	hudText((int) left, y, r, g, b, line); \
+	y += 15; \
+	s++;
+	PROFILE_STAGES(StageText)
+#undef StageText
+	sprintf(line, "CPU total  %6.2f ms avg %6.2f ms max", avg[numProfileStages] / max(nFrames, 1), worst[numProfileStages]);
+	hudText((int) left, y, 1.0f, 1.0f, 1.0f, line);
+	y += 15;
+	if (gpuTiming) {
+		sprintf(line, "GPU        %6.2f ms avg %6.2f ms max", avg[numProfileStages + 1] / max(nGPUFrames, 1),
+				worst[numProfileStages + 1]);
+		hudText((int) left, y, 1.0f, 0.6f, 0.1f, line);
+		y += 15;
+	}
+	if (profileStatus[0] != '\0') {
+		hudText((int) left, y, 0.6f, 0.9f, 1.0f, profileStatus);
+	}
+
+	glDisable(GL_BLEND); CheckError();
+	glEnable(GL_DEPTH_TEST); CheckError();
+}
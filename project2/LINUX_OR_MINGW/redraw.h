@@ -0,0 +1,36 @@
+// Redrawing only when something changes (redraw.h)
+
+// Frames are drawn on demand.  Input, menus and tool callbacks call requestRedraw when
+// they change something, and while walking objects are in view display calls
+// scheduleAnimationFrame, which redraws from a timer at up to maxAnimFPS.  With nothing
+// to draw there's no idle function, so GLUT sleeps waiting for events.  (Walking objects
+// that are out of view only move when something else causes a redraw.)
+//
+// With --continuous on the command line, frames are drawn back to back from the idle
+// function instead, as fast as possible.  Without a window (see headless.h) the caller
+// draws every frame itself, so requests are ignored.
+
+bool continuousRedraw = false;  // Set by --continuous
+double maxAnimFPS = 60.0;  // Set by --fps
+bool animFramePending = false;  // An animation timer is waiting to fire
+bool windowless = false;  // Set when drawing headless, so there's no GLUT
+
+void requestRedraw() {
+	if (windowless) return;
+	glutPostRedisplay();
+}
+
+static void animationTimer(int unused) {
+	animFramePending = false;
+	glutPostRedisplay();
+}
+
+// Draw another frame for animation, no sooner than 1/maxAnimFPS seconds after the
+// frame that started at frameStart.
+void scheduleAnimationFrame(double frameStart) {
+	if (continuousRedraw || windowless || animFramePending) return;
+
+	double delay = frameStart + 1.0 / maxAnimFPS - clockSeconds();
+	animFramePending = true;
+	glutTimerFunc(max(0, (int) (delay * 1000.0)), animationTimer, 0);
+}
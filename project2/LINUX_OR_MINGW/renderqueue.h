@@ -0,0 +1,132 @@
+// Sorted render queue and bind tracking (renderqueue.h)
+
+// Each frame every object to be drawn is pushed with a 32-bit key built from the state
+// it needs: program, mesh (VAO), texture, then depth.  Sorting by key puts draws that
+// share state next to each other, so submitting them in order needs far fewer binds.
+// Keys are sorted with an LSD radix sort, 8 bits per pass, which is linear in the number
+// of draws (and stable, so equal keys stay in scene order).
+
+#include <stdint.h>
+
+// Key layout, from the most significant bits down.  The bits must add up to 32.
+const int keyProgramBits = 4, keyMeshBits = 8, keyTextureBits = 8, keyDepthBits = 12;
+const float keyMaxDepth = 500.0f;  // Matches the far plane set in reshape.
+
+typedef struct {
+	uint64_t *items;  // (key << 32) | object number
+	uint64_t *scratch;  // Second buffer for the radix sort.
+	int count, capacity;
+} RenderQueue;
+
+// Depth is the distance in front of the camera.  It's quantised logarithmically so
+// nearby objects, where ordering matters most, get the finest resolution.
+uint32_t drawKey(int program, int mesh, int texture, float depth) {
+	float d = log2f(1.0f + max(0.0f, min(depth, keyMaxDepth))) / log2f(1.0f + keyMaxDepth);
+	uint32_t depthBits = (uint32_t) (d * ((1 << keyDepthBits) - 1));
+
+	uint32_t key = (uint32_t) program;
+	key = (key << keyMeshBits) | (uint32_t) mesh;
+	key = (key << keyTextureBits) | (uint32_t) texture;
+	key = (key << keyDepthBits) | depthBits;
+	return key;
+}
+
+void renderQueueReset(RenderQueue *q) {
+	q->count = 0;
+}
+
+void renderQueuePush(RenderQueue *q, uint32_t key, int objNum) {
+	if (q->count == q->capacity) {
+		q->capacity = max(256, q->capacity * 2);
+		q->items = (uint64_t*) realloc(q->items, sizeof(uint64_t) * q->capacity);
+		q->scratch = (uint64_t*) realloc(q->scratch, sizeof(uint64_t) * q->capacity);
+		if (q->items == NULL || q->scratch == NULL) {
+			failInt("Error - out of memory for render queue of size", q->capacity);
+		}
+	}
+	q->items[q->count++] = ((uint64_t) key << 32) | (uint32_t) objNum;
+}
+
+uint32_t renderQueueKey(const RenderQueue *q, int n) {
+	return (uint32_t) (q->items[n] >> 32);
+}
+
+int renderQueueObject(const RenderQueue *q, int n) {
+	return (int) (q->items[n] & 0xFFFFFFFF);
+}
+
+// Sort by key, least significant byte first.  A byte that's the same for every item
+// (e.g. the shader variant, when every mesh uses the same one) is skipped.
+void renderQueueSort(RenderQueue *q) {
+	int counts[4][256];
+	memset(counts, 0, sizeof(counts));
+	for (int i = 0; i < q->count; i++) {
+		uint32_t key = renderQueueKey(q, i);
+		for (int pass = 0; pass < 4; pass++) {
+			counts[pass][(key >> (pass * 8)) & 0xFF]++;
+		}
+	}
+
+	for (int pass = 0; pass < 4; pass++) {
+		int shift = 32 + pass * 8;
+		if (q->count == 0 || counts[pass][(q->items[0] >> shift) & 0xFF] == q->count) {
+			continue;
+		}
+
+		int offset = 0;
+		for (int b = 0; b < 256; b++) {
+			int c = counts[pass][b];
+			counts[pass][b] = offset;
+			offset += c;
+		}
+		for (int i = 0; i < q->count; i++) {
+			q->scratch[counts[pass][(q->items[i] >> shift) & 0xFF]++] = q->items[i];
+		}
+
+		uint64_t *t = q->items;
+		q->items = q->scratch;
+		q->scratch = t;
+	}
+}
+
+// ---- [Bind tracking] --------------------------------------------------------
+// The program, VAO and texture (on unit 0) currently bound.  Binding what's already
+// bound is skipped and counted.  Call invalidateBindings after any code that binds
+// without going through these functions (e.g. mesh and texture loading).
+
+const GLuint unknownBinding = ~0u;
+GLuint boundProgram = unknownBinding, boundVAO = unknownBinding, boundTexture = unknownBinding;
+
+void invalidateBindings() {
+	boundProgram = boundVAO = boundTexture = unknownBinding;
+}
+
+void useProgram(GLuint program) {
+	if (program == boundProgram) {
+		frameStats.bindsSaved++;
+		return;
+	}
+	glUseProgram(program); CheckError();
+	boundProgram = program;
+	frameStats.programBinds++;
+}
+
+void bindVertexArray(GLuint vao) {
+	if (vao == boundVAO) {
+		frameStats.bindsSaved++;
+		return;
+	}
+	glBindVertexArray(vao); CheckError();
+	boundVAO = vao;
+	frameStats.vaoBinds++;
+}
+
+void bindTexture(GLuint texture) {
+	if (texture == boundTexture) {
+		frameStats.bindsSaved++;
+		return;
+	}
+	glBindTexture(GL_TEXTURE_2D, texture); CheckError();
+	boundTexture = texture;
+	frameStats.textureBinds++;
+}
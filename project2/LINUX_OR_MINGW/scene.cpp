@@ -20,12 +20,50 @@ GLint windowWidth = 960, windowHeight = 640;
 
 using namespace std;  // Import the C++ standard functions (e.g. min)
 
-// IDs for the GLSL program and variables:
-GLuint shaderProgram;  // The number identifying the GLSL shader program.
-GLuint vPosition, vNormal, vTexCoord;  // IDs for input variables (from glGetAttribLocation)
-GLuint vBoneIDs, vBoneWeights;
-GLuint projectionU, modelViewU;  // IDs for uniform variables (from glGetUniformLocation)
-GLuint boneTransformsU;
+#include "frameclock.h"
+#include "redraw.h"
+#include "framestats.h"
+#include "uniforms.h"
+#include "renderqueue.h"
+#include "streambuffer.h"
+#include "instancing.h"
+#include "culling.h"
+#include "occlusion.h"
+#include "mesharena.h"
+#include "multidraw.h"
+#include "profiler.h"
+#include "sceneobjects.h"
+#include "lights.h"
+#include "bonepalette.h"
+#include "shadervariants.h"
+#include "depthprepass.h"
+#include "governor.h"
+#include "picking.h"
+#include "aabbtree.h"
+#include "mathbench.h"
+#include "headless.h"
+
+// Handles for the uniform variables, which skip redundant glUniform* calls (see uniforms.h).
+// The projection, view, lights and each object's model-view matrix and material are in
+// uniform blocks instead, written to uniformRing (see instancing.h).
+typedef struct {
+	UniformInt bonePalette;  // Buffer texture unit (see bonepalette.h), not in variants without bones
+	UniformInt texture;
+	UniformInt lightData, clusterData, lightIndices;  // Buffer texture units (see lights.h)
+} SceneUniforms;
+
+// The GLSL program for each shader variant (see shadervariants.h), 0 until it's compiled.
+typedef struct {
+	GLuint program;
+	SceneUniforms uniforms;
+} SceneVariant;
+
+SceneVariant sceneVariants[numInfluenceLevels][numLightVariants];
+SceneVariant depthVariants[numInfluenceLevels], overdrawVariants[numInfluenceLevels];
+int meshInfluenceLevel[numMeshes];  // The variant level each mesh is drawn with
+StreamBuffer uniformRing;  // Per-frame uniform block data (see streambuffer.h)
+StreamBuffer indirectRing;  // Per-frame draw commands, with multi-draw (see multidraw.h)
+bool allowMultiDraw = true;  // Cleared by --no-multidraw
 
 static float viewDist = 7.5;  // Distance from the camera to the centre of the scene.
 static float camRotSidewaysDeg = 0.0;  // Rotates the camera sideways around the centre.
@@ -43,8 +81,11 @@ int numDisplayCalls = 0;  // Used to calculate the number of frames per second.
 // Uses the type aiMesh from ../../assimp--3.0.1270/include/assimp/mesh.h
 //     (numMeshes is defined in gnatidread.h)
 aiMesh *meshes[numMeshes];  // For each mesh we have a pointer to the mesh to draw
-GLuint vaoIDs[numMeshes];  // and a corresponding VAO ID from glGenVertexArrays.
+MeshRange meshRanges[numMeshes];  // and where its vertices and indices are in the arena.
+MeshArena meshArena;  // The buffers and VAO shared by all meshes (see mesharena.h)
 const aiScene *scenes[numMeshes];
+MeshBounds meshBounds[numMeshes];  // Bounding box and sphere of each mesh (see culling.h)
+MeshTriangles meshTriangles[numMeshes];  // Each mesh's triangle BVH, for picking (see picking.h)
 
 // ---- [Textures] -------------------------------------------------------------
 //     (numTextures is defined in gnatidread.h)
@@ -53,37 +94,45 @@ GLuint textureIDs[numTextures];  // Stores the IDs returned by glGenTextures.
 
 // ---- [Scene objects] --------------------------------------------------------
 
-// For each object in a scene we store the following...
-// Note: the following is exactly what the sample solution uses, you can do things differently if you want.
-typedef struct {
-	vec4 loc;
-	float scale;
-	float angles[3];  // Rotations around X, Y and Z axes.
-	float diffuse, specular, ambient;  // Amount of each light component.
-	float shine;
-	vec3 rgb;
-	float brightness;  // Multiplies all colours.
-	int meshId;
-	int texId;
-	float texScale;
-	float walkSpeed, walkDist;
-	int motionType;
-} SceneObject;
-
-const int maxObjects = 1024;  // Scenes with more than 1024 objects seem unlikely.
+// Objects are stored as structure-of-arrays, in transforms and materials (see sceneobjects.h).
+
 const int numSaves = 30;
 const int saveHeader = ('S' | 'A' << 8 | 'V' << 16 | 'E' << 24);
 
-SceneObject sceneObjs[maxObjects];  // An array storing the objects currently in the scene.
-int nObjects = 0;  // How many objects are currently in the scene.
 int currObject = -1;  // The current object.
 int toolObj = -1;  // The object currently being modified.
 
+// The walk animation plays animCycles times while walking out, then in reverse walking back.
+const double animCycles = 3.0;
+
+RenderQueue renderQueue;  // The objects to draw this frame, sorted by state (renderqueue.h)
+
+// Each object's walk position (0 to 1 and back), bone pose time and model-view matrix for
+// this frame, and its bounding sphere in eye coordinates for frustum culling.  (Like every
+// per-object array, these are registered with the object store: see registerSceneArrays.)
+float *objWalkTime;
+float *objPoseTime;
+mat4 *objModelView;
+
+// Model matrices are cached, and only rebuilt when an object's transform is marked dirty
+// or its walk position changes.  Model-view matrices are also rebuilt when the view
+// changes, which increments viewVersion.
+mat4 *objModel;
+float *objModelWalkTime;  // The walk position objModel was built for
+unsigned int *objViewVersion;  // The view objModelView was built for
+unsigned int viewVersion = 1;
+CullSpheres eyeSpheres;
+FrustumPlanes viewFrustum;  // Set from the projection in the reshape function
+
+OcclusionState *occlusion;  // Each object's occlusion query (see occlusion.h)
+int *occlusionCandidates;  // Objects hidden last frame, drawn conditionally
+
 // ---- [Texture loading] ------------------------------------------------------
 
 // Loads a texture by number, and binds it for later use.
 void loadTextureIfNotAlreadyLoaded(int texNum) {
 	if (textures[texNum] != NULL) return;  // Already loaded
+	ProfileScope scope(stageLoad);
 
 	textures[texNum] = loadTextureNum(texNum);
 	glActiveTexture(GL_TEXTURE0); CheckError();
@@ -108,34 +157,56 @@ void loadTextureIfNotAlreadyLoaded(int texNum) {
 // The following uses the Open Asset Importer library via loadMesh in
 // gnatidread.h to load models in .x format, including vertex positions,
 // normals and texture coordinates.
-// You shouldn't need to modify this - it's called from drawMesh below.
+// You shouldn't need to modify this - it's called from display below.
 void loadMeshIfNotAlreadyLoaded(int meshNum) {
 	if (meshNum < 0 || meshNum >= numMeshes) {
 		failInt("Error - no such model number:", meshNum);
 	}
 
 	if (meshes[meshNum] != NULL) return;  // Already loaded
+	ProfileScope scope(stageLoad);
 
 	const aiScene *scene = loadScene(meshNum);
 	scenes[meshNum] = scene;
 	aiMesh *mesh = scene->mMeshes[0];
 	meshes[meshNum] = mesh;
 
-	glBindVertexArray(vaoIDs[meshNum]); CheckError();
+	// Get boneIDs and boneWeights for each vertex from the imported mesh data.
+	int nVerts = mesh->mNumVertices;
+	GLint boneIDs[nVerts][4];
+	GLfloat boneWeights[nVerts][4];
+	getBonesAffectingEachVertex(mesh, boneIDs, boneWeights);
+	computeMeshBounds(&meshBounds[meshNum], mesh, scene, boneIDs, boneWeights);
+	buildMeshTriangles(&meshTriangles[meshNum], mesh, boneIDs, boneWeights);
+
+	// Draw the mesh with the variant for the most bones any of its vertices is blended from.
+	int maxInfluences = 0;
+	for (int v = 0; v < nVerts && mesh->mNumBones > 0; v++) {
+		int influences = 0;
+		while (influences < 4 && boneWeights[v][influences] > 0.0f) influences++;
+		maxInfluences = max(maxInfluences, influences);
+	}
+	meshInfluenceLevel[meshNum] = influenceLevel(maxInfluences);
 
-	// Create and initialize a buffer object for positions and texture coordinates, initially empty.
+	// Interleave the position, texture coordinate, normal and bone data of each vertex.
 	// mesh->mTextureCoords[0] has space for up to 3 dimensions, but we only need 2.
-	GLuint buffer;
-	glGenBuffers(1, &buffer); CheckError();
-	glBindBuffer(GL_ARRAY_BUFFER, buffer); CheckError();
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * (3+3+3) * mesh->mNumVertices,
-			NULL, GL_STATIC_DRAW); CheckError();
-
-	// Next, we load the position and texCoord data in parts.
-	int nVerts = mesh->mNumVertices;
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * 3 * nVerts, mesh->mVertices); CheckError();
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(float) * 3 * nVerts, sizeof(float) * 3 * nVerts, mesh->mTextureCoords[0]); CheckError();
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(float) * 6 * nVerts, sizeof(float) * 3 * nVerts, mesh->mNormals); CheckError();
+	ArenaVertex *vertices = (ArenaVertex*) malloc(sizeof(ArenaVertex) * nVerts);
+	if (vertices == NULL) {
+		failInt("Error - out of memory for vertices:", nVerts);
+	}
+	for (int v = 0; v < nVerts; v++) {
+		ArenaVertex *vert = &vertices[v];
+		for (int c = 0; c < 3; c++) {
+			vert->position[c] = mesh->mVertices[v][c];
+			vert->normal[c] = mesh->mNormals[v][c];
+		}
+		vert->texCoord[0] = mesh->mTextureCoords[0][v].x;
+		vert->texCoord[1] = mesh->mTextureCoords[0][v].y;
+		for (int k = 0; k < 4; k++) {
+			vert->boneIDs[k] = boneIDs[v][k];
+			vert->boneWeights[k] = boneWeights[v][k];
+		}
+	}
 
 	// Load the element index data.
 	GLuint elements[mesh->mNumFaces * 3];
@@ -145,47 +216,164 @@ void loadMeshIfNotAlreadyLoaded(int meshNum) {
 		elements[i*3+2] = mesh->mFaces[i].mIndices[2];
 	}
 
-	GLuint elementBuffer;
-	glGenBuffers(1, &elementBuffer); CheckError();
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer); CheckError();
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * mesh->mNumFaces * 3, elements, GL_STATIC_DRAW); CheckError();
+	meshRanges[meshNum] = arenaAddMesh(&meshArena, vertices, nVerts, elements, mesh->mNumFaces * 3);
+	free(vertices);
+}
+
+// ---- [Shader variables] -----------------------------------------------------
+
+void initSceneUniforms(SceneUniforms *u, GLuint program, bool hasBones, bool hasLighting) {
+	if (hasBones) {
+		u->bonePalette.init(program, "bonePalette");
+	}
+	if (hasLighting) {
+		u->texture.init(program, "texture");
+		u->lightData.init(program, "lightData");
+		u->clusterData.init(program, "clusterData");
+		u->lightIndices.init(program, "lightIndices");
+	}
+}
+
+// Use the shader variant of a kind (see shadervariants.h) for an influence level and the
+// current number of global lights, compiling it first if it's new.
+SceneVariant *useSceneVariant(int level, int kind) {
+	int lights = lightVariant(lightClusters.nGlobal);
+	SceneVariant *v = kind == depthOnly ? &depthVariants[level]
+			: kind == countOverdraw ? &overdrawVariants[level] : &sceneVariants[level][lights];
+	if (v->program == 0) {
+		ProfileScope scope(stageLoad);
+		v->program = compileSceneVariant(level, lights, kind);
+		invalidateBindings();  // InitShader uses the program directly
+		useProgram(v->program);
+		initSceneUniforms(&v->uniforms, v->program, level > 0, kind == shadeFragments);
+		bindUniformBlocks(v->program);
+
+		// Texture 0 is the only texture type in this program, and is for the RGB colour of
+		// the surface but there could be separate types, e.g. specularity and normals.
+		if (kind == shadeFragments) {
+			v->uniforms.texture.set(0);
+			v->uniforms.lightData.set(lightDataUnit);
+			v->uniforms.clusterData.set(clusterDataUnit);
+			v->uniforms.lightIndices.set(lightIndexUnit);
+		}
+		if (level > 0) {
+			v->uniforms.bonePalette.set(bonePaletteUnit);
+		}
+	}
+	useProgram(v->program);
+	return v;
+}
 
-	// vPosition is actually 4D - the conversion sets the fourth dimension (i.e. w) to 1.0.
-	glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0)); CheckError();
-	glEnableVertexAttribArray(vPosition); CheckError();
+// -----------------------------------------------------------------------------
 
-	// vTexCoord is actually 2D - the third dimension is ignored (it's always 0.0).
-	glVertexAttribPointer(vTexCoord, 3, GL_FLOAT, GL_FALSE, 0,
-			BUFFER_OFFSET(sizeof(float) * 3 * nVerts)); CheckError();
-	glEnableVertexAttribArray(vTexCoord); CheckError();
-	glVertexAttribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, 0,
-			BUFFER_OFFSET(sizeof(float) * 6 * nVerts)); CheckError();
-	glEnableVertexAttribArray(vNormal); CheckError();
+// ---- [Object tree] ----------------------------------------------------------
 
-	// Get boneIDs and boneWeights for each vertex from the imported mesh data.
-	GLint boneIDs[nVerts][4];
-	GLfloat boneWeights[nVerts][4];
-	getBonesAffectingEachVertex(mesh, boneIDs, boneWeights);
+// Every object's world space box is in objectTree (see aabbtree.h), updated as its model
+// matrix is rebuilt in renderFrame.
+AABBTree objectTree = { NULL, 0, -1, -1, 0, 0 };
+int *objLeaf;  // Each object's leaf, or -1 until it's first placed
 
-	GLuint buffers[2];
-	glGenBuffers(2, buffers); CheckError();  // Add two vertex buffer objects
+// Give an object's leaf its box for its new model matrix.
+static void updateObjectLeaf(int i) {
+	MeshBounds *bounds = &meshBounds[transforms.meshId[i]];
+	vec3 boxMin, boxMax;
+	transformBox(objModel[i], bounds->boxMin, bounds->boxMax, &boxMin, &boxMax);
+	if (objLeaf[i] >= 0) {
+		aabbMove(&objectTree, objLeaf[i], boxMin, boxMax);
+	} else {
+		objLeaf[i] = aabbInsert(&objectTree, i, boxMin, boxMax);
+	}
+}
+
+// Delete an object, and its leaf.  The last object moves into its place (see
+// removeObject), so its leaf is renumbered.
+static void removeSceneObject(int i) {
+	if (objLeaf[i] >= 0) {
+		aabbRemove(&objectTree, objLeaf[i]);
+	}
+	removeObject(i);
+	if (i < nObjects && objLeaf[i] >= 0) {
+		objectTree.nodes[objLeaf[i]].item = i;
+	}
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]); CheckError();
-	glBufferData(GL_ARRAY_BUFFER, sizeof(int) * 4 * nVerts, boneIDs, GL_STATIC_DRAW); CheckError();
-	glVertexAttribIPointer(vBoneIDs, 4, GL_INT, 0, BUFFER_OFFSET(0)); CheckError();
-	glEnableVertexAttribArray(vBoneIDs); CheckError();
+// Delete every object from firstObject on.
+static void removeSceneObjectsFrom(int firstObject) {
+	while (nObjects > firstObject) {
+		removeSceneObject(nObjects - 1);
+	}
+	removeLightsFrom(firstObject);
+}
+
+// Register the scene's own per-object arrays with the object store (see sceneobjects.h).
+static void registerSceneArrays() {
+	static const int noLeaf = -1;
+	initObjectStore();
+	registerObjectArray(&objWalkTime, sizeof(float), NULL);
+	registerObjectArray(&objPoseTime, sizeof(float), NULL);
+	registerObjectArray(&objModelView, sizeof(mat4), NULL);
+	registerObjectArray(&objModel, sizeof(mat4), NULL);
+	registerObjectArray(&objModelWalkTime, sizeof(float), NULL);
+	registerObjectArray(&objViewVersion, sizeof(unsigned int), NULL);
+	registerObjectArray(&occlusion, sizeof(OcclusionState), NULL);  // Queries are kept for reuse
+	registerObjectArray(&occlusionCandidates, sizeof(int), NULL);
+	registerObjectArray(&objLeaf, sizeof(int), &noLeaf);
+}
+
+static bool objectVisible(void *context, int i) {
+	return eyeSpheres.visible[i];
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, buffers[1]); CheckError();
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 4 * nVerts, boneWeights, GL_STATIC_DRAW); CheckError();
-	glVertexAttribPointer(vBoneWeights, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0)); CheckError();
-	glEnableVertexAttribArray(vBoneWeights); CheckError();
+// Whether a light with a range reaches any object that's visible this frame.
+static bool lightReachesVisible(const vec4 &position, float range) {
+	return aabbAnyInSphere(&objectTree, vec3(position.x, position.y, position.z), range, objectVisible, NULL);
+}
+
+// ---- [Picking] --------------------------------------------------------------
+
+// Where the pick ray hits an object's triangles, in its pose for this frame.
+static float hitObject(void *context, int i, const Ray &ray, float tMax) {
+	int meshId = transforms.meshId[i];
+	MeshTriangles *m = &meshTriangles[meshId];
+	if (m->boneIDs != NULL) {
+		mat4 boneTransforms[meshes[meshId]->mNumBones];
+		calculateAnimPose(meshes[meshId], scenes[meshId], 0, objPoseTime[i], boneTransforms);
+		poseMeshTriangles(m, boneTransforms, objPoseTime[i]);
+	}
+
+	mat4 toModel = inverse(objModel[i]);
+	vec4 origin = toModel * vec4(ray.origin, 1.0), dir = toModel * vec4(ray.dir, 0.0);
+	return rayCastMesh(m, makeRay(vec3(origin.x, origin.y, origin.z), vec3(dir.x, dir.y, dir.z)), tMax);
+}
+
+// The object under a point in the window, or -1.  Objects are placed as they were in the
+// last frame drawn, which is what's on the screen (and what the object tree holds).
+static int pickObject(int x, int y) {
+	Ray ray = mouseRay(projection, view, x, y, windowWidth, windowHeight);
+	float t = 1.0f;  // The ray runs from the near plane (0) to the far plane (1)
+	return aabbRayCast(&objectTree, ray, &t, hitObject, NULL);
+}
+
+// Make the object under the mouse the current object.
+static void selectObjectAt(int x, int y) {
+	double start = clockSeconds();
+	int i = pickObject(x, y);
+	double ms = (clockSeconds() - start) * 1000.0;
+	if (i >= 0) {
+		currObject = i;
+		printf("Selected object %d (mesh %d), picked in %.3f ms\n", i, transforms.meshId[i], ms);
+	} else {
+		printf("No object there, picked in %.3f ms\n", ms);
+	}
 }
 
 // -----------------------------------------------------------------------------
 
 static void mouseClickOrScroll(int button, int state, int x, int y) {
 	if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
-		if (glutGetModifiers() != GLUT_ACTIVE_SHIFT) {
+		if (glutGetModifiers() == GLUT_ACTIVE_CTRL) {
+			selectObjectAt(x, y);  // Ctrl+click selects
+		} else if (glutGetModifiers() != GLUT_ACTIVE_SHIFT) {
 			activateTool(button);
 		} else {
 			activateTool(GLUT_MIDDLE_BUTTON);
@@ -199,9 +387,11 @@ static void mouseClickOrScroll(int button, int state, int x, int y) {
 	} else if (button == 3) {
 		// Scroll up
 		viewDist = (viewDist < 0.0 ? viewDist : viewDist * 0.8) - 0.05;
+		requestRedraw();
 	} else if (button == 4) {
 		// Scroll down
 		viewDist = (viewDist < 0.0 ? viewDist : viewDist * 1.25) + 0.05;
+		requestRedraw();
 	}
 }
 
@@ -226,15 +416,15 @@ static void adjustCamSideUp(vec2 su) {
 }
 
 static void adjustLocXZ(vec2 xz) {
-	SceneObject *obj = &sceneObjs[toolObj];
-	obj->loc[0] += xz[0];
-	obj->loc[2] += xz[1];
+	transforms.loc[0][toolObj] += xz[0];
+	transforms.loc[2][toolObj] += xz[1];
+	markTransformDirty(toolObj);
 }
 
 static void adjustScaleY(vec2 sy) {
-	SceneObject *obj = &sceneObjs[toolObj];
-	obj->scale += sy[0];
-	obj->loc[1] += sy[1];
+	transforms.scale[toolObj] += sy[0];
+	transforms.loc[1][toolObj] += sy[1];
+	markTransformDirty(toolObj);
 }
 
 // Set the mouse buttons to rotate the camera around the centre of the scene.
@@ -245,220 +435,528 @@ static void doRotate() {
 
 // Add an object to the scene.
 static void addObject(int id) {
-	if (nObjects == maxObjects) return;
-
 	vec2 currPos = currMouseXYWorld(camRotSidewaysDeg);
 
-	SceneObject *obj = &sceneObjs[nObjects];
-	obj->loc[0] = currPos[0];
-	obj->loc[1] = 0.0;
-	obj->loc[2] = currPos[1];
-	obj->loc[3] = 1.0;
+	int i = addObjectSlot();
+	setObjectLoc(i, currPos[0], 0.0, currPos[1]);
 
 	if (id != 0 && id != 55) {
-		obj->scale = 0.005;
+		transforms.scale[i] = 0.005;
 	}
 
-	obj->rgb[0] = 0.7;
-	obj->rgb[1] = 0.7;
-	obj->rgb[2] = 0.7;
-	obj->brightness = 1.0;
+	materials.rgb[0][i] = 0.7;
+	materials.rgb[1][i] = 0.7;
+	materials.rgb[2][i] = 0.7;
+	materials.brightness[i] = 1.0;
 
-	obj->diffuse = 1.0;
-	obj->specular = 0.5;
-	obj->ambient = 0.7;
-	obj->shine = 10.0;
+	materials.diffuse[i] = 1.0;
+	materials.specular[i] = 0.5;
+	materials.ambient[i] = 0.7;
+	materials.shine[i] = 10.0;
 
-	obj->angles[0] = 0.0;
-	obj->angles[1] = 180.0;
-	obj->angles[2] = 0.0;
+	transforms.angles[0][i] = 0.0;
+	transforms.angles[1][i] = 180.0;
+	transforms.angles[2][i] = 0.0;
 
-	obj->meshId = id;
-	obj->texId = 1 + (rand() % (numTextures - 1));
-	obj->texScale = 2.0;
+	transforms.meshId[i] = id;
+	materials.texId[i] = 1 + (rand() % (numTextures - 1));
+	materials.texScale[i] = 2.0;
 
 	if (id >= 56) {
-		obj->walkSpeed = 50.0;
-		obj->walkDist = 5.0;
+		transforms.walkSpeed[i] = 50.0;
+		transforms.walkDist[i] = 5.0;
 	} else {
-		obj->walkSpeed = 0.0;
-		obj->walkDist = 0.0;
+		transforms.walkSpeed[i] = 0.0;
+		transforms.walkDist[i] = 0.0;
 	}
-	obj->motionType = 0;
+	transforms.motionType[i] = 0;
+	transforms.animTime[i] = transforms.prevAnimTime[i] = 0.0;
+	markTransformDirty(i);
+	occlusion[i].occluded = false;
 
-	toolObj = currObject = nObjects++;
+	toolObj = currObject = i;
 	setToolCallbacks(adjustLocXZ, camRotZ(),
 			adjustScaleY, mat2(0.05, 0.0, 0.0, 10.0));
-	glutPostRedisplay();
+	requestRedraw();
+}
+
+// Add a small sphere that's also a light (with a limited range), placed like any new object.
+static void addLightObject() {
+	if (nLights == maxLights) return;
+
+	int i = nObjects;
+	addObject(55);
+	transforms.scale[i] = 0.1;
+	materials.texId[i] = 0;  // Plain texture
+	materials.brightness[i] = 0.2;
+	markTransformDirty(i);
+	addLight(objectHandle(i), objectLoc(i), objectRGB(i), materials.brightness[i], 5.0);
 }
 
 // The init function.
 void init(void) {
-	srand(time(NULL));  // Initialize random seed (so the starting scene varies)
+	srand(fixedDtMode ? 0 : time(NULL));  // Initialize random seed (so the starting scene varies)
 	aiInit();
 
-	glGenVertexArrays(numMeshes, vaoIDs); CheckError();  // Allocate vertex array objects for meshes
 	glGenTextures(numTextures, textureIDs); CheckError();  // Allocate texture objects
 
-	// Load shaders and use the resulting shader program.
-	shaderProgram = InitShader("vshader.glsl", "fshader.glsl");
+	// Compile the shader variant for static meshes now (the others are compiled when first
+	// drawn).  This also checks the uniform blocks and finds their offset alignment.
+	useSceneVariant(0, shadeFragments);
 
-	glUseProgram(shaderProgram); CheckError();
+	// All meshes go in one arena, starting with room for 64K vertices and 256K indices.
+	// Every shader variant uses the same attribute locations.
+	arenaInit(&meshArena, sceneArenaAttribs(), 1 << 16, 1 << 18);
 
-	// Initialize the vertex position attribute from the vertex shader.
-	vPosition = glGetAttribLocation(shaderProgram, "vPosition"); CheckError();
-	vNormal = glGetAttribLocation(shaderProgram, "vNormal"); CheckError();
+	initOcclusion();
+	initProfiler();
 
-	// Likewise, initialize the vertex texture coordinates attribute.
-	vTexCoord = glGetAttribLocation(shaderProgram, "vTexCoord"); CheckError();
+	// Room for 256 objects per frame to start with; it grows as needed.  The tail lets a
+	// whole ObjectBlock be bound from any offset.
+	streamInit(&uniformRing, GL_UNIFORM_BUFFER, 256 * (sizeof(ObjectData) + uniformOffsetAlignment),
+			objectBlockSize);
 
-	vBoneIDs = glGetAttribLocation(shaderProgram, "boneIDs"); CheckError();
-	vBoneWeights = glGetAttribLocation(shaderProgram, "boneWeights"); CheckError();
+	initMultiDraw(allowMultiDraw);
+	if (multiDraw) {
+		streamInit(&indirectRing, GL_DRAW_INDIRECT_BUFFER, 1024 * sizeof(DrawElementsIndirectCommand), 0);
+	}
 
-	projectionU = glGetUniformLocation(shaderProgram, "Projection"); CheckError();
-	modelViewU = glGetUniformLocation(shaderProgram, "ModelView"); CheckError();
-	boneTransformsU = glGetUniformLocation(shaderProgram, "boneTransforms"); CheckError();
+	initLights();
+	initBonePalettes();
+	registerSceneArrays();
 
 	// Objects 0 and 1 are the ground and the first light.
 	addObject(0);  // Square for the ground
-	SceneObject *groundObj = &sceneObjs[0];
-	groundObj->loc = vec4(0.0, 0.0, 0.0, 1.0);
-	groundObj->scale = 10.0;
-	groundObj->angles[0] = 90.0;  // Rotate it
-	groundObj->texScale = 5.0; // Repeat the texture
+	setObjectLoc(0, 0.0, 0.0, 0.0);
+	transforms.scale[0] = 10.0;
+	transforms.angles[0][0] = 90.0;  // Rotate it
+	materials.texScale[0] = 5.0; // Repeat the texture
 
 	addObject(55);  // Sphere for the first light
-	SceneObject *lightObj1 = &sceneObjs[1];
-	lightObj1->loc = vec4(2.0, 1.0, 1.0, 1.0);
-	lightObj1->scale = 0.1;
-	lightObj1->texId = 0;  // Plain texture
-	lightObj1->brightness = 0.2;  // The light's brightness is 5 times this (below)
+	setObjectLoc(1, 2.0, 1.0, 1.0);
+	transforms.scale[1] = 0.1;
+	materials.texId[1] = 0;  // Plain texture
+	materials.brightness[1] = 0.2;  // The light's brightness is 5 times this (below)
 
 	// [I] Add a second light to the scene.
 	addObject(55);  // Sphere for the second light
-	SceneObject *lightObj2 = &sceneObjs[2];
-	lightObj2->loc = vec4(-2.0, 1.0, -1.0, 1.0);
-	lightObj2->scale = 0.1;
-	lightObj2->texId = 0;  // Plain texture
-	lightObj2->brightness = 0.5;
+	setObjectLoc(2, -2.0, 1.0, -1.0);
+	transforms.scale[2] = 0.1;
+	materials.texId[2] = 0;  // Plain texture
+	materials.brightness[2] = 0.5;
+	resetLights();  // Shown by objects 1 and 2
 
 	addObject(1 + (rand() % (numMeshes - 1)));  // A test mesh
+	addRandomLights(extraLights);
 
 	// We need to enable the depth test to discard fragments that
 	// are behind previously drawn fragments for the same pixel.
 	glEnable(GL_DEPTH_TEST);
 	doRotate();  // Start in camera rotate mode
 	glClearColor(0.0, 0.0, 0.0, 1.0);  // Black background
+
+	initFrameClock();
 }
 
 // -----------------------------------------------------------------------------
 
-void drawMesh(SceneObject sceneObj) {
-	loadTextureIfNotAlreadyLoaded(sceneObj.texId);
-	loadMeshIfNotAlreadyLoaded(sceneObj.meshId);
-
-	aiMesh *mesh = meshes[sceneObj.meshId];
-	const aiScene *scene = scenes[sceneObj.meshId];
-
-	float poseTime = 0.0f;
-	float walkTime = 0.0f;
-	bool circle = (sceneObj.motionType == 1);
-	if (sceneObj.meshId >= 56) {
-		double animCycles = 3.0;
-		double elapsedTime = glutGet(GLUT_ELAPSED_TIME) / 1000.0;
-		double animDuration = getAnimDuration(mesh, scene, 0);
-		double animTime = fmod(elapsedTime * sceneObj.walkSpeed, (circle ? 1 : 2) * animCycles * animDuration);
-		poseTime = fmod(animTime, animDuration);
-		if (animTime >= animCycles * animDuration) {
-			poseTime = animDuration - poseTime;
-		}
-		walkTime = animTime / (animCycles * animDuration);
-		if (walkTime >= 1.0) {
-			walkTime = 2.0 - walkTime;
-		}
+// Set each object's animation duration and walk cycle length from its mesh and motion type.
+static void updateWalkCycles() {
+	ObjectTransforms *t = &transforms;
+	for (int i = 0; i < nObjects; i++) {
+		int meshId = t->meshId[i];
+		loadMeshIfNotAlreadyLoaded(meshId);
+		t->animDuration[i] = meshId >= 56 ? getAnimDuration(meshes[meshId], scenes[meshId], 0) : 0.0;
+		t->walkCycle[i] = (t->motionType[i] == 1 ? 1 : 2) * animCycles * t->animDuration[i];
 	}
+}
 
-	// Activate a texture.
-	glActiveTexture(GL_TEXTURE0); CheckError();
-	glBindTexture(GL_TEXTURE_2D, textureIDs[sceneObj.texId]); CheckError();
+// Advance the walk animation of every object by one fixed simulation step.
+static void stepAnimation(double dt) {
+	ObjectTransforms *t = &transforms;
+	memcpy(t->prevAnimTime, t->animTime, sizeof(double) * nObjects);
+	for (int i = 0; i < nObjects; i++) {
+		double cycle = t->walkCycle[i];
+		double next = t->animTime[i] + (cycle > 0.0 ? dt * t->walkSpeed[i] : 0.0);
 
-	// Texture 0 is the only texture type in this program, and is for the RGB colour of the
-	// surface but there could be separate types, e.g. specularity and normals.
-	glUniform1i(glGetUniformLocation(shaderProgram, "texture"), 0); CheckError();
+		// Wrap both steps together so interpolating between them stays smooth.
+		double wrap = (cycle > 0.0 && next >= cycle) ? floor(next / cycle) * cycle : 0.0;
+		t->animTime[i] = next - wrap;
+		t->prevAnimTime[i] -= wrap;
+	}
+}
 
-	// Set the texture scale for the shaders.
-	glUniform1f(glGetUniformLocation(shaderProgram, "texScale"), sceneObj.texScale); CheckError();
+// Interpolate each object's walk animation clock for this frame, and from it set the
+// object's walk position and the pose time for its bones.
+static void updateWalkTimes() {
+	ObjectTransforms *t = &transforms;
+	int interval = quality.animInterval;  // Lowered by the governor (see governor.h)
+	for (int i = 0; i < nObjects; i++) {
+		if (interval > 1 && (i + profileFrameNum) % interval != 0 && !t->dirty[i]) continue;
+		double animDuration = t->animDuration[i];
+		double animTime = t->prevAnimTime[i] + (t->animTime[i] - t->prevAnimTime[i]) * simAlpha;
+		if (animTime < 0.0) animTime += t->walkCycle[i];  // Interpolated back across a wrap
+
+		float poseTime = 0.0f, walkTime = 0.0f;
+		if (animDuration > 0.0) {
+			poseTime = fmod(animTime, animDuration);
+			if (animTime >= animCycles * animDuration) {
+				poseTime = animDuration - poseTime;
+			}
+			walkTime = animTime / (animCycles * animDuration);
+			if (walkTime >= 1.0) {
+				walkTime = 2.0 - walkTime;
+			}
+		}
+		objPoseTime[i] = poseTime;
+		objWalkTime[i] = walkTime;
+	}
+}
 
-	// Set the projection matrix for the shaders.
-	glUniformMatrix4fv(projectionU, 1, GL_TRUE, projection); CheckError();
+// The model matrix of an object at its walk position for this frame.
+static mat4 objectModelMatrix(int i) {
+	ObjectTransforms *t = &transforms;
+	float walkTime = objWalkTime[i];
 
 	// [B] Set the model matrix.
-	mat4 rot = RotateX(sceneObj.angles[0]) * RotateY(sceneObj.angles[1]) * RotateZ(sceneObj.angles[2]);
+	mat4 rot = RotateX(t->angles[0][i]) * RotateY(t->angles[1][i]) * RotateZ(t->angles[2][i]);
 	vec4 s;
-	if (sceneObj.motionType == 1) {
+	if (t->motionType[i] == 1) {
 		// Circular
-		float r = sceneObj.walkDist / 2;
+		float r = t->walkDist[i] / 2;
 		s = rot * vec4(cos(2 * M_PI * walkTime) * r, 0.0, sin(2 * M_PI * walkTime) * r, 0.0);
 		rot *= RotateY(360 * -walkTime);
-	} else if (sceneObj.motionType == 2) {
+	} else if (t->motionType[i] == 2) {
 		// Bouncing
-		s = rot * vec4(0.0, abs(sin(3 * M_PI * walkTime)) * 0.3, walkTime * sceneObj.walkDist, 0.0);
+		s = rot * vec4(0.0, abs(sin(3 * M_PI * walkTime)) * 0.3, walkTime * t->walkDist[i], 0.0);
 	} else {
 		// Straight line
-		s = rot * vec4(0.0, 0.0, walkTime * sceneObj.walkDist, 0.0);
+		s = rot * vec4(0.0, 0.0, walkTime * t->walkDist[i], 0.0);
 	}
-	mat4 model = Translate(sceneObj.loc + s) * rot * Scale(sceneObj.scale);
-
-	// Set the model-view matrix for the shaders.
-	glUniformMatrix4fv(modelViewU, 1, GL_TRUE, view * model); CheckError();
-
-	// Activate the VAO for a mesh.
-	glBindVertexArray(vaoIDs[sceneObj.meshId]); CheckError();
-
-	int nBones = mesh->mNumBones;
-	if (nBones == 0) nBones = 1;  // If no bones, just a single identity matrix is used
+	return Translate(objectLoc(i) + s) * rot * Scale(t->scale[i]);
+}
 
-	// Get boneTransforms for the first (0th) animation at the given time (a float measured in frames).
-	mat4 boneTransforms[nBones];
-	calculateAnimPose(mesh, scene, 0, poseTime, boneTransforms);
-	glUniformMatrix4fv(boneTransformsU, nBones, GL_TRUE, (const GLfloat*) boneTransforms);
+// Draw a group of batches (see multidraw.h) with a kind of shader variant, with the group's
+// ObjectData bound to the ObjectBlock.  The mesh arena's VAO must be bound.  The batches in
+// a group all have the same influence level (see groupBatch).  Objects with
+// bones find their poses in the frame's bone palettes (see bonepalette.h).
+void drawGroup(DrawGroup *group, int kind) {
+	DrawBatch *batch = &batches[group->firstBatch];
+	int level = meshInfluenceLevel[batch->meshId];
+	useSceneVariant(level, kind);
+
+	// Activate a texture (on texture unit 0), and the group's records in the uniform ring.
+	if (kind == shadeFragments) {
+		bindTexture(textureIDs[group->texId]);
+	}
+	streamBindRange(&uniformRing, objectBlockBinding, group->objectOffset, objectBlockSize);
 
-	glDrawElements(GL_TRIANGLES, mesh->mNumFaces * 3, GL_UNSIGNED_INT, NULL); CheckError();
+	if (multiDraw) {
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, BUFFER_OFFSET(group->commandOffset),
+				group->nBatches, 0); CheckError();
+	} else {
+		MeshRange *range = &meshRanges[batch->meshId];
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range->indexCount, GL_UNSIGNED_INT,
+				BUFFER_OFFSET(sizeof(GLuint) * range->firstIndex), batch->count, range->baseVertex); CheckError();
+	}
+	if (kind == depthOnly) {
+		frameStats.prepassDraws++;
+	} else {
+		frameStats.drawCalls++;
+		frameStats.instancesDrawn += group->instances;
+	}
 }
 
-void display(void) {
+// Draw a frame into the current framebuffer.
+static void renderFrame() {
 	numDisplayCalls++;
+	beginProfileFrame();
+	profileStage(stageAnimation);
+
+	// Sample the clock once for the whole frame, then catch the simulation up to it.
+	int simSteps = beginFrameClock();
+	updateWalkCycles();
+	for (int i = 0; i < simSteps; i++) {
+		stepAnimation(simStep);
+		simTime += simStep;
+	}
 
+	beginScaledRender(windowWidth, windowHeight);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); CheckError();
 
 	// [A] Set the view matrix.
 	mat4 rot = RotateX(camRotUpAndOverDeg) * RotateY(camRotSidewaysDeg);
-	view = Translate(0.0, 0.0, -viewDist) * rot;
-
-	SceneObject lightObj1 = sceneObjs[1];
-	vec4 lightPosition1 = view * lightObj1.loc;
-	SceneObject lightObj2 = sceneObjs[2];
-	vec4 lightPosition2 = rot * lightObj2.loc;
+	mat4 newView = Translate(0.0, 0.0, -viewDist) * rot;
+	if (memcmp((void*) &newView, (void*) &view, sizeof(mat4)) != 0) {
+		view = newView;
+		viewVersion++;
+	}
 
-	glUniform4fv(glGetUniformLocation(shaderProgram, "LightPosition1"), 1, lightPosition1); CheckError();
-	glUniform4fv(glGetUniformLocation(shaderProgram, "LightPosition2"), 1, lightPosition2); CheckError();
-	glUniform3fv(glGetUniformLocation(shaderProgram, "LightColor1"), 1, lightObj1.rgb); CheckError();
-	glUniform3fv(glGetUniformLocation(shaderProgram, "LightColor2"), 1, lightObj2.rgb); CheckError();
-	glUniform1f(glGetUniformLocation(shaderProgram, "LightBrightness1"), lightObj1.brightness); CheckError();
-	glUniform1f(glGetUniformLocation(shaderProgram, "LightBrightness2"), lightObj2.brightness); CheckError();
+	// Place every object for this frame, and move its bounding sphere into eye coordinates.
+	// (updateWalkCycles has loaded every mesh.)
+	updateWalkTimes();
+	profileStage(stageMatrices);
+	resizeCullSpheres(&eyeSpheres, nObjects);
+	int reinserts = objectTree.reinserts;
+	for (int i = 0; i < nObjects; i++) {
+		loadTextureIfNotAlreadyLoaded(materials.texId[i]);
+
+		bool moved = transforms.dirty[i] || objWalkTime[i] != objModelWalkTime[i];
+		if (moved) {
+			objModel[i] = objectModelMatrix(i);
+			objModelWalkTime[i] = objWalkTime[i];
+			transforms.dirty[i] = false;
+			frameStats.matricesRebuilt++;
+			updateObjectLeaf(i);
+		}
+		if (moved || objViewVersion[i] != viewVersion) {
+			objModelView[i] = view * objModel[i];
+			objViewVersion[i] = viewVersion;
+			frameStats.modelViewUpdates++;
+		}
+		MeshBounds *bounds = &meshBounds[transforms.meshId[i]];
+		setCullSphere(&eyeSpheres, i, objModelView[i] * vec4(bounds->centre, 1.0),
+				bounds->radius * fabs(transforms.scale[i]));
+	}
+	frameStats.treeReinserts += objectTree.reinserts - reinserts;
+	profileStage(stageCulling);
+	frameStats.objectsCulled += cullSpheresWithTree(&objectTree, &viewFrustum, view, &eyeSpheres);
+
+	// With occlusion culling, pick up any query results from earlier frames.
+	if (occlusionCulling) {
+		for (int i = 0; i < nObjects; i++) {
+			readOcclusionResult(&occlusion[i], meshes[transforms.meshId[i]]->mNumFaces);
+		}
+	}
 
+	// Queue every visible object with a key for the state it needs, and sort the queue so
+	// objects sharing a mesh and texture are drawn together (see renderqueue.h).  Objects
+	// that were occluded last frame are set aside as candidates for conditional drawing.
+	renderQueueReset(&renderQueue);
+	int nCandidates = 0;
+	float pixelsAtUnitDepth = projection[1][1] * renderHeight / 2.0f;  // Per unit of radius
 	for (int i = 0; i < nObjects; i++) {
-		SceneObject obj = sceneObjs[i];
+		if (!eyeSpheres.visible[i] || crossesNearPlane(&viewFrustum, &eyeSpheres, i)) {
+			occlusion[i].occluded = false;
+			if (!eyeSpheres.visible[i]) continue;
+		}
+		if (occlusionCulling && occlusion[i].occluded && !occlusion[i].pending) {
+			occlusionCandidates[nCandidates++] = i;
+			continue;
+		}
+		float depth = -eyeSpheres.z[i];
+		if (eyeSpheres.r[i] * pixelsAtUnitDepth < quality.detailPixels * depth) {
+			frameStats.detailCulled++;  // Too small on screen (see governor.h)
+			continue;
+		}
+		int level = meshInfluenceLevel[transforms.meshId[i]];
+		renderQueuePush(&renderQueue, drawKey(level, transforms.meshId[i], materials.texId[i], depth), i);
+	}
+	renderQueueSort(&renderQueue);
+	int nQueued = renderQueue.count;
+	for (int c = 0; c < nCandidates; c++) {
+		renderQueuePush(&renderQueue, 0, occlusionCandidates[c]);  // After the sorted objects
+	}
+	invalidateBindings();  // Loading binds VAOs and textures directly
+
+	// Split the queue into batches: runs that share a shader variant, mesh and texture, up to
+	// maxInstancesPerDraw long.
+	resetBatches();
+	for (int first = 0; first < nQueued; ) {
+		int i = renderQueueObject(&renderQueue, first);
+		int meshId = transforms.meshId[i];
+		uint32_t state = renderQueueKey(&renderQueue, first) >> keyDepthBits;
+
+		int count = 1;
+		while (first + count < nQueued && count < maxInstancesPerDraw
+				&& renderQueueKey(&renderQueue, first + count) >> keyDepthBits == state) {
+			count++;
+		}
+		addBatch(meshId, materials.texId[i], first, count);
+		first += count;
+	}
+	int nMainBatches = nBatches;
+
+	// Each candidate gets its own batch, conditional on its own query.
+	for (int c = 0; c < nCandidates; c++) {
+		int i = occlusionCandidates[c];
+		if (occlusion[i].query == 0) {
+			glGenQueries(1, &occlusion[i].query); CheckError();
+		}
+		addBatch(transforms.meshId[i], materials.texId[i], nQueued + c, 1)->conditionQuery = occlusion[i].query;
+	}
+
+	// Collect the batches into groups that are drawn by one call each (see multidraw.h).
+	// Conditional batches are drawn on their own.
+	resetGroups();
+	int nMainGroups = 0;
+	for (int b = 0; b < nBatches; b++) {
+		DrawGroup *group = groupBatch(b, meshInfluenceLevel[batches[b].meshId], batches[b].conditionQuery == 0);
+		if (b < nMainBatches) nMainGroups = nGroups;
+
+		// Objects with the same state are queued nearest first, so a batch's first object
+		// is its nearest.
+		int i = renderQueueObject(&renderQueue, batches[b].first);
+		group->nearDepth = min(group->nearDepth, -eyeSpheres.z[i] - eyeSpheres.r[i]);
+	}
+
+	// Write the frame's uniform block data into the ring: the FrameData, then the ObjectData
+	// for each group, with the bone palettes of objects with bones in their own ring.  Each
+	// record is built locally then copied into the mapped buffer.
+	assignLights(view, rot, lightReachesVisible);
+	profileStage(stageUpload);
+	uploadLights();
+	GLsizeiptr paletteBytes = 0;
+	for (int k = 0; k < renderQueue.count; k++) {
+		paletteBytes += paletteMatrixSize * meshes[transforms.meshId[renderQueueObject(&renderQueue, k)]]->mNumBones;
+	}
+	beginBonePalettes(paletteBytes);
+	streamBegin(&uniformRing, sizeof(FrameData) + renderQueue.count * sizeof(ObjectData)
+			+ (nGroups + 1) * uniformOffsetAlignment);
+
+	FrameData frame, *frameDst;
+	GLintptr frameOffset = streamAlloc(&uniformRing, sizeof(FrameData), uniformOffsetAlignment, (void**) &frameDst);
+	storeMatrix(frame.projection, projection);
+	storeMatrix(frame.view, view);
+	setClusterFrameData(&frame, renderWidth, renderHeight);
+	memcpy(frameDst, &frame, sizeof(FrameData));
+
+	for (int g = 0; g < nGroups; g++) {
+		DrawGroup *group = &groups[g];
+		ObjectData *objDst;
+		group->objectOffset = streamAlloc(&uniformRing, sizeof(ObjectData) * group->instances,
+				uniformOffsetAlignment, (void**) &objDst);
+
+		for (int b = group->firstBatch; b < group->firstBatch + group->nBatches; b++) {
+			DrawBatch *batch = &batches[b];
+			for (int k = 0; k < batch->count; k++) {
+				int i = renderQueueObject(&renderQueue, batch->first + k);
+				ObjectMaterials *m = &materials;
+
+				int meshId = transforms.meshId[i];
+				GLint palette = 0;
+				if (meshes[meshId]->mNumBones > 0) {
+					palette = addBonePalette(meshId, meshes[meshId], scenes[meshId], objPoseTime[i]);
+				}
+
+				vec3 rgb = objectRGB(i) * m->brightness[i] * 2.0;
+				ObjectData data;
+				setObjectData(&data, objModelView[i], m->ambient[i] * rgb, m->diffuse[i] * rgb, m->specular[i] * rgb,
+						m->shine[i], m->texScale[i], palette);
+				memcpy(&objDst[batch->baseInstance + k], &data, sizeof(ObjectData));
+			}
+		}
+	}
+	streamEndWrites(&uniformRing);
+	endBonePalettes();
+
+	// With multi-draw, write a command for each batch, grouped for the draws.
+	if (multiDraw) {
+		streamBegin(&indirectRing, nBatches * sizeof(DrawElementsIndirectCommand));
+		for (int g = 0; g < nGroups; g++) {
+			DrawGroup *group = &groups[g];
+			DrawElementsIndirectCommand *cmdDst;
+			group->commandOffset = streamAlloc(&indirectRing, sizeof(DrawElementsIndirectCommand) * group->nBatches,
+					sizeof(GLuint), (void**) &cmdDst);
+
+			for (int k = 0; k < group->nBatches; k++) {
+				DrawBatch *batch = &batches[group->firstBatch + k];
+				DrawElementsIndirectCommand cmd;
+				setIndirectCommand(&cmd, meshRanges[batch->meshId], batch->count, batch->baseInstance);
+				memcpy(&cmdDst[k], &cmd, sizeof(cmd));
+			}
+		}
+		streamEndWrites(&indirectRing);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectRing.buffer); CheckError();
+	}
 
-		vec3 rgb = obj.rgb * obj.brightness * 2.0;
-		glUniform3fv(glGetUniformLocation(shaderProgram, "AmbientProduct"), 1, obj.ambient * rgb); CheckError();
-		glUniform3fv(glGetUniformLocation(shaderProgram, "DiffuseProduct"), 1, obj.diffuse * rgb); CheckError();
-		glUniform3fv(glGetUniformLocation(shaderProgram, "SpecularProduct"), 1, obj.specular * rgb); CheckError();
-		glUniform1f(glGetUniformLocation(shaderProgram, "Shininess"), obj.shine); CheckError();
+	profileStage(stageSubmit);
+	bindVertexArray(meshArena.vao);
+	glActiveTexture(GL_TEXTURE0); CheckError();
+	streamBindRange(&uniformRing, frameBlockBinding, frameOffset, sizeof(FrameData));
+
+	// Draw the main groups front to back: either into the depth buffer only, before shading
+	// them in the queue's order, or shading as they go (see depthprepass.h).
+	int shadeKind = overdrawView ? countOverdraw : shadeFragments;
+	const int *order = frontToBackOrder(nMainGroups);
+	if (overdrawView) {
+		beginOverdraw();
+	}
+	if (depthPrepass) {
+		beginDepthPrepass();
+		for (int k = 0; k < nMainGroups; k++) {
+			drawGroup(&groups[order[k]], depthOnly);
+		}
+		beginShadingPass();
+		for (int g = 0; g < nMainGroups; g++) {
+			drawGroup(&groups[g], shadeKind);
+		}
+		endShadingPass();
+	} else {
+		for (int k = 0; k < nMainGroups; k++) {
+			drawGroup(&groups[order[k]], shadeKind);
+		}
+	}
+
+	if (occlusionCulling) {
+		// Query the candidates' boxes against the depth of everything drawn so far, then draw
+		// each one only if some of its box passed.  The GPU waits for the query, not the CPU.
+		if (nCandidates > 0) {
+			beginOcclusionBoxes();
+			for (int c = 0; c < nCandidates; c++) {
+				int i = occlusionCandidates[c];
+				MeshBounds *bounds = &meshBounds[transforms.meshId[i]];
+				queryOcclusionBox(&occlusion[i], projection * objModelView[i], bounds->boxMin, bounds->boxMax, true);
+			}
+			endOcclusionBoxes();
+
+			bindVertexArray(meshArena.vao);
+			for (int g = nMainGroups; g < nGroups; g++) {
+				glBeginConditionalRender(batches[groups[g].firstBatch].conditionQuery, GL_QUERY_WAIT); CheckError();
+				drawGroup(&groups[g], shadeKind);
+				glEndConditionalRender(); CheckError();
+			}
+		}
+
+		// Query the objects drawn as usual, to find any that are now hidden.
+		beginOcclusionBoxes();
+		for (int k = 0; k < nQueued; k++) {
+			int i = renderQueueObject(&renderQueue, k);
+			if (occlusion[i].pending || crossesNearPlane(&viewFrustum, &eyeSpheres, i)) continue;
+			MeshBounds *bounds = &meshBounds[transforms.meshId[i]];
+			queryOcclusionBox(&occlusion[i], projection * objModelView[i], bounds->boxMin, bounds->boxMax, false);
+		}
+		endOcclusionBoxes();
+	}
+	if (overdrawView) {
+		endOverdraw();
+	}
+	streamEndFrame(&uniformRing);
+	streamEndFrame(&bonePaletteRing);
+	if (multiDraw) {
+		streamEndFrame(&indirectRing);
+	}
 
-		drawMesh(sceneObjs[i]);
+	// Keep drawing while any walking object is in view.
+	for (int i = 0; i < nObjects; i++) {
+		if (eyeSpheres.visible[i] && transforms.walkCycle[i] > 0.0 && transforms.walkSpeed[i] > 0.0) {
+			scheduleAnimationFrame(frameStartTime);
+			break;
+		}
 	}
 
+	endScaledRender(windowWidth, windowHeight);
+	endProfileFrame();
+	governFrame();
+	CheckFrameErrors();
+	endFrameStats();
+}
+
+void display(void) {
+	renderFrame();
+	if (showProfile) {
+		drawProfileHUD(windowWidth, windowHeight);
+	}
 	glutSwapBuffers();
 }
 
@@ -472,33 +970,31 @@ static void objectMenu(int id) {
 static void texMenu(int id) {
 	deactivateTool();
 	if (currObject >= 0) {
-		sceneObjs[currObject].texId = id;
-		glutPostRedisplay();
+		materials.texId[currObject] = id;
+		requestRedraw();
 	}
 }
 
 static void groundMenu(int id) {
 	deactivateTool();
-	sceneObjs[0].texId = id;
-	glutPostRedisplay();
+	materials.texId[0] = id;
+	requestRedraw();
 }
 
 static void adjustBrightnessY(vec2 by) {
-	SceneObject *obj = &sceneObjs[toolObj];
-	obj->brightness = max(0.0f, obj->brightness + by[0]);
-	obj->loc[1] += by[1];
+	materials.brightness[toolObj] = max(0.0f, materials.brightness[toolObj] + by[0]);
+	transforms.loc[1][toolObj] += by[1];
+	markTransformDirty(toolObj);
 }
 
 static void adjustRedGreen(vec2 rg) {
-	SceneObject *obj = &sceneObjs[toolObj];
-	obj->rgb[0] = max(0.0f, obj->rgb[0] + rg[0]);
-	obj->rgb[1] = max(0.0f, obj->rgb[1] + rg[1]);
+	materials.rgb[0][toolObj] = max(0.0f, materials.rgb[0][toolObj] + rg[0]);
+	materials.rgb[1][toolObj] = max(0.0f, materials.rgb[1][toolObj] + rg[1]);
 }
 
 static void adjustBlueBrightness(vec2 bl_br) {
-	SceneObject *obj = &sceneObjs[toolObj];
-	obj->rgb[2] = max(0.0f, obj->rgb[2] + bl_br[0]);
-	obj->brightness = max(0.0f, obj->brightness + bl_br[1]);
+	materials.rgb[2][toolObj] = max(0.0f, materials.rgb[2][toolObj] + bl_br[0]);
+	materials.brightness[toolObj] = max(0.0f, materials.brightness[toolObj] + bl_br[1]);
 }
 
 static void lightMenu(int id) {
@@ -519,6 +1015,8 @@ static void lightMenu(int id) {
 		toolObj = 2;
 		setToolCallbacks(adjustRedGreen, mat2(1.0, 0.0, 0.0, 1.0),
 				adjustBlueBrightness, mat2(1.0, 0.0, 0.0, 1.0));
+	} else if (id == 85) {
+		addLightObject();
 	} else {
 		printf("Error in lightMenu\n");
 		exit(EXIT_FAILURE);
@@ -546,15 +1044,13 @@ static int createArrayMenu(int size, const char menuEntries[][128], void(*menuFn
 }
 
 static void adjustAmbientDiffuse(vec2 ad) {
-	SceneObject *obj = &sceneObjs[toolObj];
-	obj->ambient = max(0.0f, obj->ambient + ad[0]);
-	obj->diffuse = max(0.0f, obj->diffuse + ad[1]);
+	materials.ambient[toolObj] = max(0.0f, materials.ambient[toolObj] + ad[0]);
+	materials.diffuse[toolObj] = max(0.0f, materials.diffuse[toolObj] + ad[1]);
 }
 
 static void adjustSpecularShine(vec2 ss) {
-	SceneObject *obj = &sceneObjs[toolObj];
-	obj->specular = max(0.0f, obj->specular + ss[0]);
-	obj->shine = max(0.0f, obj->shine + ss[1]);
+	materials.specular[toolObj] = max(0.0f, materials.specular[toolObj] + ss[0]);
+	materials.shine[toolObj] = max(0.0f, materials.shine[toolObj] + ss[1]);
 }
 
 static void materialMenu(int id) {
@@ -577,41 +1073,43 @@ static void materialMenu(int id) {
 }
 
 static void adjustAngleYX(vec2 angle_yx) {
-	SceneObject *obj = &sceneObjs[currObject];
-	obj->angles[1] += angle_yx[0];
-	obj->angles[0] += angle_yx[1];
+	transforms.angles[1][currObject] += angle_yx[0];
+	transforms.angles[0][currObject] += angle_yx[1];
+	markTransformDirty(currObject);
 }
 
 static void adjustAngleZTexScale(vec2 az_ts) {
-	SceneObject *obj = &sceneObjs[currObject];
-	obj->angles[2] += az_ts[0];
-	obj->texScale += az_ts[1];
+	transforms.angles[2][currObject] += az_ts[0];
+	materials.texScale[currObject] += az_ts[1];
+	markTransformDirty(currObject);
 }
 
 static void duplicateObject(int id) {
-	if (nObjects == maxObjects) return;
-
-	sceneObjs[nObjects] = sceneObjs[id];
-	toolObj = currObject = nObjects++;
+	int i = addObjectSlot();
+	copyObject(i, id);
+	occlusion[i].occluded = false;
+	toolObj = currObject = i;
 	setToolCallbacks(adjustLocXZ, camRotZ(),
 			adjustScaleY, mat2(0.05, 0.0, 0.0, 10.0));
-	glutPostRedisplay();
+	requestRedraw();
 }
 
+// Delete any object but the ground and the first two lights.
 static void deleteObject(int id) {
-	if (nObjects == 3) return;
+	if (id < 3) return;
 
-	nObjects--;
+	removeSceneObject(id);
+	removeLightsFrom(nObjects);  // Just drops the object's light, if it had one
 	currObject = (nObjects > 3 ? nObjects - 1 : -1);
 	toolObj = -1;
 	doRotate();
-	glutPostRedisplay();
+	requestRedraw();
 }
 
 static void adjustWalkSpeedDist(vec2 walk_sd) {
-	SceneObject *obj = &sceneObjs[currObject];
-	obj->walkSpeed = max(0.0f, obj->walkSpeed + walk_sd[0]);
-	obj->walkDist = max(0.0f, obj->walkDist + walk_sd[1]);
+	transforms.walkSpeed[currObject] = max(0.0f, transforms.walkSpeed[currObject] + walk_sd[0]);
+	transforms.walkDist[currObject] = max(0.0f, transforms.walkDist[currObject] + walk_sd[1]);
+	markTransformDirty(currObject);
 }
 
 static void mainMenu(int id) {
@@ -629,7 +1127,9 @@ static void mainMenu(int id) {
 		setToolCallbacks(adjustWalkSpeedDist, mat2(24.0, 0.0, 0.0, 5.0),
 				adjustWalkSpeedDist, mat2(24.0, 0.0, 0.0, 5.0));
 	} else if (id == 61 && currObject >= 0) {
-		sceneObjs[currObject].motionType = (sceneObjs[currObject].motionType + 1) % 3;
+		transforms.motionType[currObject] = (transforms.motionType[currObject] + 1) % 3;
+		markTransformDirty(currObject);
+		requestRedraw();
 	} else if (id == 90 && currObject >= 0) {
 		duplicateObject(currObject);
 	} else if (id == 91 && currObject >= 0) {
@@ -639,14 +1139,15 @@ static void mainMenu(int id) {
 	}
 }
 
-static void loadMenu(int id) {
+// Load the scene saved in a slot, returning false if it can't be read.
+static bool loadSlot(int id) {
 	char fileName[256];
 	sprintf(fileName, "slot%d.sav", id);
 
 	FILE *file = fopen(fileName, "rb");
 	if (file == NULL) {
 		fprintf(stderr, "Error: Could not open '%s' for reading\n", fileName);
-		return;
+		return false;
 	}
 
 	int header;
@@ -654,20 +1155,36 @@ static void loadMenu(int id) {
 	if (header != saveHeader) {
 		fprintf(stderr, "Error: Invalid save file header");
 		fclose(file);
-		return;
+		return false;
 	}
 	fread(&viewDist, sizeof(float), 1, file);
 	fread(&camRotSidewaysDeg, sizeof(float), 1, file);
 	fread(&camRotUpAndOverDeg, sizeof(float), 1, file);
-	fread(&nObjects, sizeof(int), 1, file);
-	memset(sceneObjs, 0, sizeof(SceneObject) * nObjects);
-	fread(sceneObjs, sizeof(SceneObject), nObjects, file);
+	int n = 0;
+	fread(&n, sizeof(int), 1, file);
+	n = max(n, 3);
+	removeSceneObjectsFrom(3);  // Save files don't record which other objects were lights
+	while (nObjects < n) {
+		addObjectSlot();
+	}
+	for (int i = 0; i < nObjects; i++) {
+		SceneObject rec;
+		memset(&rec, 0, sizeof(SceneObject));
+		fread(&rec, sizeof(SceneObject), 1, file);
+		recordToObject(&rec, i);
+	}
 
 	currObject = nObjects - 1;
 	toolObj = -1;
 	doRotate();
+	requestRedraw();
 
 	fclose(file);
+	return true;
+}
+
+static void loadMenu(int id) {
+	loadSlot(id);
 }
 
 static void saveMenu(int id) {
@@ -685,7 +1202,11 @@ static void saveMenu(int id) {
 	fwrite(&camRotSidewaysDeg, sizeof(float), 1, file);
 	fwrite(&camRotUpAndOverDeg, sizeof(float), 1, file);
 	fwrite(&nObjects, sizeof(int), 1, file);
-	fwrite(sceneObjs, sizeof(SceneObject), nObjects, file);
+	for (int i = 0; i < nObjects; i++) {
+		SceneObject rec;
+		objectToRecord(i, &rec);
+		fwrite(&rec, sizeof(SceneObject), 1, file);
+	}
 
 	fflush(file);
 	fclose(file);
@@ -706,6 +1227,7 @@ static void makeMenu() {
 	glutAddMenuEntry("R/G/B/All Light 1", 71);
 	glutAddMenuEntry("Move Light 2", 80);
 	glutAddMenuEntry("R/G/B/All Light 2", 81);
+	glutAddMenuEntry("Add Light", 85);
 
 	char saveMenuEntries[numSaves][128];
 	for (int i = 0; i < numSaves; i++) {
@@ -740,11 +1262,35 @@ void keyboard(unsigned char key, int x, int y) {
 		case 0x1B:
 			exit(EXIT_SUCCESS);
 			break;
+		case 's':
+			showStats = !showStats;  // Print rendering counters once a second
+			break;
+		case 'o':
+			occlusionCulling = !occlusionCulling;  // See occlusion.h
+			requestRedraw();
+			break;
+		case 'z':
+			depthPrepass = !depthPrepass;  // See depthprepass.h
+			requestRedraw();
+			break;
+		case 'v':
+			overdrawView = !overdrawView;  // Show how many fragments each pixel shades
+			requestRedraw();
+			break;
+		case 'p':
+			showProfile = !showProfile;  // Draw frame timings over the scene (see profiler.h)
+			requestRedraw();
+			break;
+		case 'g':
+			setGovernor(!governorOn);  // Trade quality for frame time (see governor.h)
+			requestRedraw();
+			break;
 	}
 }
 
 // -----------------------------------------------------------------------------
 
+// Only used with --continuous (see redraw.h).
 void idle(void) {
 	glutPostRedisplay();
 }
@@ -773,7 +1319,10 @@ void reshape(int width, int height) {
 		top = nearDist;
 	}
 
-	projection = Frustum(left, right, bottom, top, 0.2, 500.0);
+	GLfloat nearPlane = 0.2, farPlane = 500.0;
+	projection = Frustum(left, right, bottom, top, nearPlane, farPlane);
+	extractFrustumPlanes(&viewFrustum, projection);
+	setClusterProjection(projection, nearPlane, farPlane);
 }
 
 void timer(int unused) {
@@ -783,9 +1332,127 @@ void timer(int unused) {
 	glutSetWindowTitle(title);
 
 	numDisplayCalls = 0;
+	reportFrameStats();
 	glutTimerFunc(1000, timer, 0);
 }
 
+// ---- [Headless benchmark] ---------------------------------------------------
+
+// Draw nFrames frames offscreen (after warmup untimed ones) while the camera orbits the
+// scene once, timing each from the start of drawing until the GPU finishes.  The frame
+// stats (see framestats.h) are left holding the totals for the timed frames.
+static void timeOrbit(double *frameTimes, int nFrames, int warmup, const char *pngPrefix) {
+	float startDeg = camRotSidewaysDeg;
+
+	for (int frame = -warmup; frame < nFrames; frame++) {
+		if (frame == 0) {
+			memset(&statsTotals, 0, sizeof(FrameStats));  // Only count the timed frames
+			statsFrames = 0;
+		}
+		camRotSidewaysDeg = startDeg + 360.0f * max(frame, 0) / nFrames;
+
+		double start = clockSeconds();
+		renderFrame();
+		glFinish(); CheckError();
+		if (frame < 0) continue;
+		frameTimes[frame] = (clockSeconds() - start) * 1000.0;
+
+		if (pngPrefix != NULL && frame % benchPNGEvery == 0) {
+			saveFramePNG(pngPrefix, frame, windowWidth, windowHeight);
+		}
+	}
+	camRotSidewaysDeg = startDeg;
+}
+
+// Replace everything but the ground and lights with count generated objects, the same
+// every run: static meshes, animated (walking) meshes, or a mix of both with every
+// motion type.  They're spread in a grid over the ground, scaled down to fit.
+static void buildBenchScene(const char *kind, int count) {
+	srand(12345);
+	removeSceneObjectsFrom(3);
+	viewDist = 7.5;
+	camRotSidewaysDeg = 0.0;
+	camRotUpAndOverDeg = 20.0;
+
+	int side = (int) ceil(sqrt((double) count));
+	float spacing = 18.0f / side;
+	for (int k = 0; k < count; k++) {
+		int meshId;
+		if (strcmp(kind, "static") == 0) {
+			meshId = 1 + k % 54;  // Meshes 1 to 54 (55 is the lights' sphere)
+		} else if (strcmp(kind, "animated") == 0) {
+			meshId = 56 + k % 3;
+		} else {
+			meshId = (k % 2 == 0) ? 1 + (k / 2) % 54 : 56 + (k / 2) % 3;
+		}
+
+		int i = nObjects;
+		addObject(meshId);
+		setObjectLoc(i, -9.0f + spacing * (k % side + 0.5f), 0.0f, -9.0f + spacing * (k / side + 0.5f));
+		transforms.scale[i] *= min(1.0f, spacing / 2.0f);
+		transforms.angles[1][i] = rand() % 360;
+		if (strcmp(kind, "mixed") == 0) {
+			transforms.motionType[i] = k % 3;
+		}
+	}
+	currObject = toolObj = -1;
+}
+
+// Time the --slot scene (or the starting scene), write the results and exit.
+static void runHeadlessBenchmark() {
+	createRenderTarget(windowWidth, windowHeight);
+	reshape(windowWidth, windowHeight);
+	if (benchSlot >= 0 && !loadSlot(benchSlot)) {
+		exit(EXIT_FAILURE);
+	}
+
+	double *frameTimes = (double*) malloc(sizeof(double) * benchFrames);
+	if (frameTimes == NULL) {
+		failInt("Error - out of memory for frame times:", benchFrames);
+	}
+	timeOrbit(frameTimes, benchFrames, benchWarmup, benchPNGPrefix);
+	writeBenchJSON(benchJSONFile, frameTimes, benchFrames, windowWidth, windowHeight);
+	free(frameTimes);
+	exit(EXIT_SUCCESS);
+}
+
+// Time every generated scene kind at every size, print a table of the results and exit.
+static void runBenchSuite() {
+	createRenderTarget(windowWidth, windowHeight);
+	reshape(windowWidth, windowHeight);
+
+	double *frameTimes = (double*) malloc(sizeof(double) * benchFrames);
+	BenchResult results[numBenchSceneKinds * numBenchSceneSizes];
+	if (frameTimes == NULL) {
+		failInt("Error - out of memory for frame times:", benchFrames);
+	}
+
+	int n = 0;
+	for (int kind = 0; kind < numBenchSceneKinds; kind++) {
+		for (int size = 0; size < numBenchSceneSizes; size++) {
+			BenchResult *res = &results[n++];
+			res->kind = benchSceneKinds[kind];
+			res->objects = benchSceneSizes[size];
+			printf("Timing %s scene with %d objects\n", res->kind, res->objects);
+			fflush(stdout);
+
+			buildBenchScene(res->kind, res->objects);
+			timeOrbit(frameTimes, benchFrames, benchWarmup, NULL);
+			res->frameMs = summarizeFrameTimes(frameTimes, benchFrames);
+			res->drawCalls = (double) statsTotals.drawCalls / statsFrames;
+			res->instancesDrawn = (double) statsTotals.instancesDrawn / statsFrames;
+			res->objectsCulled = (double) statsTotals.objectsCulled / statsFrames;
+		}
+	}
+
+	printBenchTable(results, n);
+	if (benchJSONFile != NULL) {
+		writeBenchSuiteJSON(benchJSONFile, results, n, benchFrames);
+	}
+	free(frameTimes);
+	exit(EXIT_SUCCESS);
+}
+
 char dirDefault1[] = "models-textures";
 char dirDefault2[] = "/c/temp/models-textures";
 char dirDefault3[] = "/tmp/models-textures";
@@ -803,15 +1470,79 @@ void fileErr(char *fileName) {
 }
 
 int main(int argc, char *argv[]) {
+	double startTime = clockSeconds();
+
 	// Get the program name (excluding the directory) for the window title.
 	programName = argv[0];
 	for (char *p = argv[0]; *p != '\0'; p++) {
 		if (*p == '/' || *p == '\\') programName = p+1;
 	}
 
+	// Options come before the models-textures directory.
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-'; argi++) {
+		if (strcmp(argv[argi], "--fixed-dt") == 0) {
+			fixedDtMode = true;  // Advance one simulation step per frame (for benchmarking)
+		} else if (strcmp(argv[argi], "--stats") == 0) {
+			showStats = true;
+		} else if (strcmp(argv[argi], "--occlusion") == 0) {
+			occlusionCulling = true;
+		} else if (strcmp(argv[argi], "--continuous") == 0) {
+			continuousRedraw = true;  // Redraw from the idle function (see redraw.h)
+		} else if (strcmp(argv[argi], "--fps") == 0 && argi + 1 < argc) {
+			maxAnimFPS = max(1.0, atof(argv[++argi]));
+		} else if (strcmp(argv[argi], "--no-shader-cache") == 0) {
+			shaderCache = false;  // Always compile shaders from source (see shadervariants.h)
+		} else if (strcmp(argv[argi], "--no-multidraw") == 0) {
+			allowMultiDraw = false;  // Draw each batch with its own call (see multidraw.h)
+		} else if (strcmp(argv[argi], "--lights") == 0 && argi + 1 < argc) {
+			extraLights = max(0, atoi(argv[++argi]));  // Free standing lights, for testing (see lights.h)
+		} else if (strcmp(argv[argi], "--depth-prepass") == 0) {
+			depthPrepass = true;  // Draw depth first, then shade with GL_EQUAL (see depthprepass.h)
+		} else if (strcmp(argv[argi], "--overdraw") == 0) {
+			overdrawView = true;
+		} else if (strcmp(argv[argi], "--governor") == 0 && argi + 1 < argc) {
+			governorOn = true;  // Keep frames within a budget in ms (see governor.h)
+			frameBudgetMs = max(1.0, atof(argv[++argi]));
+		} else if (strcmp(argv[argi], "--profile") == 0) {
+			showProfile = true;
+		} else if (strcmp(argv[argi], "--profile-csv") == 0 && argi + 1 < argc) {
+			profileCSVFile = argv[++argi];
+		} else if (strcmp(argv[argi], "--headless") == 0) {
+			headlessMode = true;  // Benchmark offscreen, without a window (see headless.h)
+		} else if (strcmp(argv[argi], "--bench-suite") == 0) {
+			benchSuite = true;  // Time generated scenes of each size (implies --headless)
+			headlessMode = true;
+		} else if (strcmp(argv[argi], "--bench-tree") == 0) {
+			benchAABBTree();  // Time the object tree on its own, then exit (see aabbtree.h)
+		} else if (strcmp(argv[argi], "--bench-math") == 0) {
+			benchMath();  // Time the matrix operations, then exit (see mathbench.h)
+		} else if (strcmp(argv[argi], "--slot") == 0 && argi + 1 < argc) {
+			benchSlot = atoi(argv[++argi]);
+		} else if (strcmp(argv[argi], "--frames") == 0 && argi + 1 < argc) {
+			benchFrames = max(1, atoi(argv[++argi]));
+		} else if (strcmp(argv[argi], "--warmup") == 0 && argi + 1 < argc) {
+			benchWarmup = max(0, atoi(argv[++argi]));
+		} else if (strcmp(argv[argi], "--size") == 0 && argi + 1 < argc) {
+			if (sscanf(argv[++argi], "%dx%d", &windowWidth, &windowHeight) != 2 || windowWidth < 1 || windowHeight < 1) {
+				fprintf(stderr, "Error: --size needs WIDTHxHEIGHT\n");
+				exit(EXIT_FAILURE);
+			}
+		} else if (strcmp(argv[argi], "--json") == 0 && argi + 1 < argc) {
+			benchJSONFile = argv[++argi];
+		} else if (strcmp(argv[argi], "--png") == 0 && argi + 1 < argc) {
+			benchPNGPrefix = argv[++argi];
+		} else if (strcmp(argv[argi], "--png-every") == 0 && argi + 1 < argc) {
+			benchPNGEvery = max(1, atoi(argv[++argi]));
+		} else {
+			fprintf(stderr, "Unknown option: %s\n", argv[argi]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	// Set the models-textures directory, via the first argument or some handy defaults.
-	if (argc > 1) {
-		strcpy(dataDir, argv[1]);
+	if (argi < argc) {
+		strcpy(dataDir, argv[argi]);
 	} else if (opendir(dirDefault1)) {
 		strcpy(dataDir, dirDefault1);
 	} else if (opendir(dirDefault2)) {
@@ -824,24 +1555,55 @@ int main(int argc, char *argv[]) {
 		fileErr(dirDefault1);
 	}
 
-	glutInit(&argc, argv);
-	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
-	glutInitWindowSize(windowWidth, windowHeight);
-
-	glutInitContextVersion(3, 2);
-	//glutInitContextProfile(GLUT_CORE_PROFILE);
-	glutInitContextProfile(GLUT_COMPATIBILITY_PROFILE);
+	if (headlessMode) {
+		windowless = true;
+		fixedDtMode = true;  // Every run animates the same way
+		createHeadlessContext();  // Also loads the entry points
+	} else {
+		glutInit(&argc, argv);
+		glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
+		glutInitWindowSize(windowWidth, windowHeight);
+
+		glutInitContextVersion(3, 2);
+		//glutInitContextProfile(GLUT_CORE_PROFILE);
+		glutInitContextProfile(GLUT_COMPATIBILITY_PROFILE);
+#if GL_CHECK_LEVEL >= 1
+		glutInitContextFlags(GLUT_DEBUG);  // So KHR_debug reports everything (see CheckError.h)
+#endif
+
+		glutCreateWindow("Initialising...");
+
+		glewExperimental = GL_TRUE;
+		glewInit(); CheckError();
+		LoadGLExtra();  // Entry points newer than the bundled glew.h (see GLExtra.h)
+	}
+#if GL_CHECK_LEVEL >= 1
+	if (!EnableGLDebugOutput(GL_CHECK_LEVEL >= 2, &glCallSite)) {
+		printf("KHR_debug is not available, so GL errors are only found with glGetError\n");
+	}
+#endif
 
-	glutCreateWindow("Initialising...");
+	if (shaderCache) {
+		SetShaderCacheDir(shaderCacheDir);
+	}
+	init();
 
-	glewExperimental = GL_TRUE;
-	glewInit(); CheckError();
+	// Report how long startup took, and how much of it went on the scene's shaders.
+	ShaderCacheStats cacheStats = GetShaderCacheStats();
+	printf("Started in %.0f ms, %.1f ms of it on scene shaders (%d programs from the cache, %d compiled)\n",
+			(clockSeconds() - startTime) * 1000.0, shaderSeconds * 1000.0, cacheStats.loaded, cacheStats.compiled);
 
-	init();
+	if (benchSuite) {
+		runBenchSuite();  // Doesn't return
+	} else if (headlessMode) {
+		runHeadlessBenchmark();  // Doesn't return
+	}
 
 	glutDisplayFunc(display);
 	glutKeyboardFunc(keyboard);
-	glutIdleFunc(idle);
+	if (continuousRedraw) {
+		glutIdleFunc(idle);
+	}
 
 	glutMouseFunc(mouseClickOrScroll);
 	glutPassiveMotionFunc(mousePassiveMotion);
@@ -0,0 +1,336 @@
+// Scene objects, stored as structure-of-arrays (sceneobjects.h)
+
+// Each field of the scene's objects has its own array, indexed by object number, so a loop
+// over one field reads contiguous memory (and the compiler can vectorize it).  The fields
+// used every frame to move and place objects are in transforms; the material and texture,
+// which are only read when writing each object's ObjectData, are in materials.
+//
+// The arrays are kept dense, objects 0 to nObjects - 1, and grow as needed, so there's no
+// limit on the number of objects.  Deleting an object moves the last one into its place.
+// Anything that refers to an object across edits (such as a light shown by it) keeps an
+// ObjectHandle rather than its number (see the object store below).
+//
+// SceneObject is only used for the records in save files.
+
+#ifdef _WIN32
+#  include <malloc.h>  // _aligned_malloc
+#endif
+
+int nObjects = 0;  // How many objects are currently in the scene.
+
+// An object as stored in a save file.
+typedef struct {
+	float loc[4];
+	float scale;
+	float angles[3];  // Rotations around X, Y and Z axes.
+	float diffuse, specular, ambient;  // Amount of each light component.
+	float shine;
+	float rgb[3];
+	float brightness;  // Multiplies all colours.
+	int meshId;
+	int texId;
+	float texScale;
+	float walkSpeed, walkDist;
+	int motionType;
+} SceneObject;
+
+typedef struct {
+	float *loc[3];  // x, y and z of each location (w is always 1).
+	float *scale;
+	float *angles[3];  // Rotations around X, Y and Z axes.
+	int *meshId;
+	int *motionType;
+	float *walkSpeed, *walkDist;
+
+	// The walk animation clock (in animation frames) at the latest and previous simulation steps.
+	double *animTime, *prevAnimTime;
+
+	// From the mesh and motion type, set before each frame's simulation steps.
+	double *animDuration;  // 0 if the object doesn't walk.
+	double *walkCycle;  // A full walk out and back, in animation frames.
+
+	// Set when any field above that places the object changes, so its cached model matrix
+	// is rebuilt (walking is tracked separately, by the walk position).
+	bool *dirty;
+} ObjectTransforms;
+
+typedef struct {
+	float *rgb[3];
+	float *brightness;  // Multiplies all colours.
+	float *diffuse, *specular, *ambient;  // Amount of each light component.
+	float *shine;
+	int *texId;
+	float *texScale;
+} ObjectMaterials;
+
+ObjectTransforms transforms;
+ObjectMaterials materials;
+
+// Every per-object array, for operations on whole objects.
+#define TRANSFORM_FIELDS(X) \
+	X(loc[0]) X(loc[1]) X(loc[2]) X(scale) X(angles[0]) X(angles[1]) X(angles[2]) \
+	X(meshId) X(motionType) X(walkSpeed) X(walkDist) X(animTime) X(prevAnimTime) \
+	X(animDuration) X(walkCycle)
+#define MATERIAL_FIELDS(X) \
+	X(rgb[0]) X(rgb[1]) X(rgb[2]) X(brightness) X(diffuse) X(specular) X(ambient) X(shine) \
+	X(texId) X(texScale)
+
+// ---- [Object store] ---------------------------------------------------------
+
+// Every per-object array, here and elsewhere, is registered with the store, which grows
+// them all together (doubling) and moves their entries when an object is deleted.
+//
+// The arrays are 16-byte aligned, as mat4 and vec4 are (see ../../include/vec.h): the
+// compiler copies them with aligned SIMD instructions, and malloc doesn't always align
+// that far (e.g. on 32-bit MinGW).
+//
+// A handle names a slot, which follows its object as it moves, and the slot's generation,
+// which changes when the object is deleted.  So a handle to a deleted object is detected,
+// even after its slot is reused.
+
+typedef struct {
+	int slot;  // -1 for no object
+	unsigned int generation;
+} ObjectHandle;
+
+const ObjectHandle noObject = { -1, 0 };
+
+const int maxObjectArrays = 64;
+const size_t maxObjectElementSize = 256;
+
+typedef struct {
+	void **array;
+	size_t elementSize;
+	const void *initial;  // What a new object's entry is set to, or NULL to leave it
+} ObjectArray;
+
+typedef struct {
+	ObjectArray arrays[maxObjectArrays];
+	int nArrays;
+	int capacity;  // Of every registered array
+
+	int *slotOf;  // Each object's slot (a registered array)
+	int *objectOf;  // Each slot's object, or for free slots, the next free slot
+	unsigned int *generation;  // Each slot's generation
+	int nSlots, slotCapacity;
+	int freeSlot;  // -1 if none
+} ObjectStore;
+
+ObjectStore objectStore = { {}, 0, 0, NULL, NULL, NULL, 0, 0, -1 };
+
+const size_t objectArrayAlignment = 16;
+
+// Allocate and free 16-byte aligned memory, or return NULL if there's none.
+void *alignedAlloc(size_t bytes) {
+#ifdef _WIN32
+	return _aligned_malloc(bytes, objectArrayAlignment);
+#else
+	void *p;
+	return posix_memalign(&p, objectArrayAlignment, bytes) == 0 ? p : NULL;
+#endif
+}
+
+void alignedFree(void *p) {
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+// Register an array with an entry per object.  *arrayPtr is allocated now (aligned), and
+// grown with the others; new space is zeroed.
+void registerObjectArray(void *arrayPtr, size_t elementSize, const void *initial) {
+	ObjectStore *st = &objectStore;
+	if (st->nArrays == maxObjectArrays || elementSize > maxObjectElementSize) {
+		failInt("Error - can't register object array of element size", (int) elementSize);
+	}
+	ObjectArray *a = &st->arrays[st->nArrays++];
+	a->array = (void**) arrayPtr;
+	a->elementSize = elementSize;
+	a->initial = initial;
+	size_t bytes = elementSize * max(st->capacity, 1);
+	*a->array = alignedAlloc(bytes);
+	if (*a->array == NULL) {
+		failInt("Error - out of memory for objects:", st->capacity);
+	}
+	memset(*a->array, 0, bytes);
+}
+
+static void growObjectArrays(int capacity) {
+	ObjectStore *st = &objectStore;
+	for (int k = 0; k < st->nArrays; k++) {
+		ObjectArray *a = &st->arrays[k];
+		char *grown = (char*) alignedAlloc(a->elementSize * capacity);
+		if (grown == NULL) {
+			failInt("Error - out of memory for objects:", capacity);
+		}
+		memcpy(grown, *a->array, a->elementSize * st->capacity);
+		memset(grown + a->elementSize * st->capacity, 0, a->elementSize * (capacity - st->capacity));
+		alignedFree(*a->array);
+		*a->array = grown;
+	}
+	st->capacity = capacity;
+}
+
+#define RegisterTransform(field)  registerObjectArray(&transforms.field, sizeof(*transforms.field), NULL);
+#define RegisterMaterial(field)  registerObjectArray(&materials.field, sizeof(*materials.field), NULL);
+
+void initObjectStore() {
+	static const bool newIsDirty = true;
+	TRANSFORM_FIELDS(RegisterTransform)
+	MATERIAL_FIELDS(RegisterMaterial)
+	registerObjectArray(&transforms.dirty, sizeof(bool), &newIsDirty);
+	registerObjectArray(&objectStore.slotOf, sizeof(int), NULL);
+}
+
+#undef RegisterTransform
+#undef RegisterMaterial
+
+// Add an object at the end, with a new handle, returning its number.  Its fields are left
+// for the caller to set, apart from those registered with an initial value.
+int addObjectSlot() {
+	ObjectStore *st = &objectStore;
+	if (nObjects == st->capacity) {
+		growObjectArrays(max(256, st->capacity * 2));
+	}
+
+	int slot = st->freeSlot;
+	if (slot >= 0) {
+		st->freeSlot = st->objectOf[slot];
+	} else {
+		if (st->nSlots == st->slotCapacity) {
+			st->slotCapacity = max(256, st->slotCapacity * 2);
+			st->objectOf = (int*) realloc(st->objectOf, sizeof(int) * st->slotCapacity);
+			st->generation = (unsigned int*) realloc(st->generation, sizeof(unsigned int) * st->slotCapacity);
+			if (st->objectOf == NULL || st->generation == NULL) {
+				failInt("Error - out of memory for object slots:", st->slotCapacity);
+			}
+		}
+		slot = st->nSlots++;
+		st->generation[slot] = 0;
+	}
+
+	int i = nObjects++;
+	for (int k = 0; k < st->nArrays; k++) {
+		ObjectArray *a = &st->arrays[k];
+		if (a->initial != NULL) {
+			memcpy((char*) *a->array + a->elementSize * i, a->initial, a->elementSize);
+		}
+	}
+	st->slotOf[i] = slot;
+	st->objectOf[slot] = i;
+	return i;
+}
+
+ObjectHandle objectHandle(int i) {
+	ObjectHandle h = { objectStore.slotOf[i], objectStore.generation[objectStore.slotOf[i]] };
+	return h;
+}
+
+// The number of a handle's object, or -1 if it has been deleted (or is noObject).
+int objectIndex(ObjectHandle h) {
+	const ObjectStore *st = &objectStore;
+	if (h.slot < 0 || h.slot >= st->nSlots || st->generation[h.slot] != h.generation) return -1;
+	return st->objectOf[h.slot];
+}
+
+// Delete object i by swapping the last object into its place, entry by entry in every
+// registered array.  (So the deleted object's entries end up past the end, where things
+// like GL names in them can be reused.)
+void removeObject(int i) {
+	ObjectStore *st = &objectStore;
+	int last = nObjects - 1;
+	int slot = st->slotOf[i];
+	st->generation[slot]++;
+	st->objectOf[slot] = st->freeSlot;
+	st->freeSlot = slot;
+
+	if (i != last) {
+		char tmp[maxObjectElementSize];
+		for (int k = 0; k < st->nArrays; k++) {
+			ObjectArray *a = &st->arrays[k];
+			char *x = (char*) *a->array + a->elementSize * i, *y = (char*) *a->array + a->elementSize * last;
+			memcpy(tmp, x, a->elementSize);
+			memcpy(x, y, a->elementSize);
+			memcpy(y, tmp, a->elementSize);
+		}
+		st->objectOf[st->slotOf[i]] = i;
+	}
+	nObjects--;
+}
+
+// ---- [Object fields] --------------------------------------------------------
+
+void markTransformDirty(int i) {
+	transforms.dirty[i] = true;
+}
+
+vec4 objectLoc(int i) {
+	return vec4(transforms.loc[0][i], transforms.loc[1][i], transforms.loc[2][i], 1.0);
+}
+
+void setObjectLoc(int i, float x, float y, float z) {
+	transforms.loc[0][i] = x;
+	transforms.loc[1][i] = y;
+	transforms.loc[2][i] = z;
+	markTransformDirty(i);
+}
+
+vec3 objectRGB(int i) {
+	return vec3(materials.rgb[0][i], materials.rgb[1][i], materials.rgb[2][i]);
+}
+
+void copyObject(int dst, int src) {
+#define CopyTransform(field)  transforms.field[dst] = transforms.field[src];
+#define CopyMaterial(field)  materials.field[dst] = materials.field[src];
+	TRANSFORM_FIELDS(CopyTransform)
+	MATERIAL_FIELDS(CopyMaterial)
+#undef CopyTransform
+#undef CopyMaterial
+	markTransformDirty(dst);
+}
+
+// Convert between objects and save file records.
+void objectToRecord(int i, SceneObject *rec) {
+	for (int c = 0; c < 3; c++) {
+		rec->loc[c] = transforms.loc[c][i];
+		rec->angles[c] = transforms.angles[c][i];
+		rec->rgb[c] = materials.rgb[c][i];
+	}
+	rec->loc[3] = 1.0f;
+	rec->scale = transforms.scale[i];
+	rec->diffuse = materials.diffuse[i];
+	rec->specular = materials.specular[i];
+	rec->ambient = materials.ambient[i];
+	rec->shine = materials.shine[i];
+	rec->brightness = materials.brightness[i];
+	rec->meshId = transforms.meshId[i];
+	rec->texId = materials.texId[i];
+	rec->texScale = materials.texScale[i];
+	rec->walkSpeed = transforms.walkSpeed[i];
+	rec->walkDist = transforms.walkDist[i];
+	rec->motionType = transforms.motionType[i];
+}
+
+void recordToObject(const SceneObject *rec, int i) {
+	for (int c = 0; c < 3; c++) {
+		transforms.loc[c][i] = rec->loc[c];
+		transforms.angles[c][i] = rec->angles[c];
+		materials.rgb[c][i] = rec->rgb[c];
+	}
+	transforms.scale[i] = rec->scale;
+	materials.diffuse[i] = rec->diffuse;
+	materials.specular[i] = rec->specular;
+	materials.ambient[i] = rec->ambient;
+	materials.shine[i] = rec->shine;
+	materials.brightness[i] = rec->brightness;
+	transforms.meshId[i] = rec->meshId;
+	materials.texId[i] = rec->texId;
+	materials.texScale[i] = rec->texScale;
+	transforms.walkSpeed[i] = rec->walkSpeed;
+	transforms.walkDist[i] = rec->walkDist;
+	transforms.motionType[i] = rec->motionType;
+	transforms.animTime[i] = transforms.prevAnimTime[i] = 0.0;
+	markTransformDirty(i);
+}
@@ -0,0 +1,73 @@
+// Specialised variants of the scene's shader program (shadervariants.h)
+
+// vshader.glsl and fshader.glsl are compiled into several programs, specialised with
+// #defines inserted by InitShader.  BONE_INFLUENCES is the most bones any vertex is blended
+// from (0, 1, 2 or 4): with 0 the vertex shader skips the bone blend and doesn't read the
+// bone attributes at all, which is the common case of a static mesh.  GLOBAL_LIGHTS, when
+// defined, is the number of global lights (see lights.h), giving the fragment shader's loop
+// over them a constant bound.  Each mesh is drawn with the variant for its own influence
+// count, and variants are compiled the first time they're used.
+//
+// The depth pre-pass and the overdraw view have variants of their own, with the same
+// vertex shader and depthfshader.glsl (see depthprepass.h).  They have no lighting, so
+// only the influence level matters.
+//
+// Every variant binds its attributes to the same fixed locations, so they can all draw
+// from the mesh arena's one VAO.
+//
+// Linked variants are kept in a program binary cache (see SetShaderCacheDir in Angel.h),
+// so after the first run they load instead of compiling.
+
+const int numInfluenceLevels = 4;
+const int levelInfluences[numInfluenceLevels] = { 0, 1, 2, 4 };
+
+// Light variants below specialisedGlobalLights have that many global lights; the last
+// loops over however many there are.
+const int specialisedGlobalLights = 4;
+const int numLightVariants = specialisedGlobalLights + 1;
+
+// What a variant's fragment shader does.
+enum { shadeFragments, depthOnly, countOverdraw };
+
+// Attribute locations, the same in every variant.
+enum { attribPosition, attribNormal, attribTexCoord, attribBoneIDs, attribBoneWeights, attribInstance };
+const char *const sceneAttribNames[] = {
+	"vPosition", "vNormal", "vTexCoord", "boneIDs", "boneWeights", "vInstance", NULL
+};
+
+ArenaAttribs sceneArenaAttribs() {
+	ArenaAttribs attribs = { attribPosition, attribTexCoord, attribNormal, attribBoneIDs, attribBoneWeights,
+			attribInstance };
+	return attribs;
+}
+
+// The lowest influence level that covers the most nonzero bone weights of any vertex.
+int influenceLevel(int maxInfluences) {
+	int level = 0;
+	while (level < numInfluenceLevels - 1 && levelInfluences[level] < maxInfluences) level++;
+	return level;
+}
+
+const char shaderCacheDir[] = "shader-cache";
+bool shaderCache = true;  // Cleared by --no-shader-cache
+double shaderSeconds = 0.0;  // Time spent compiling or loading variants
+
+int lightVariant(int nGlobalLights) {
+	return min(nGlobalLights, specialisedGlobalLights);
+}
+
+// Compile and link one variant, or load it from the cache.  (InitShader leaves it in use.)
+GLuint compileSceneVariant(int level, int lightVariant, int kind) {
+	double start = clockSeconds();
+	char defines[128];
+	int n = snprintf(defines, sizeof(defines), "#define BONE_INFLUENCES %d\n", levelInfluences[level]);
+	if (kind == countOverdraw) {
+		snprintf(defines + n, sizeof(defines) - n, "#define OVERDRAW 1\n");
+	} else if (kind == shadeFragments && lightVariant < specialisedGlobalLights) {
+		snprintf(defines + n, sizeof(defines) - n, "#define GLOBAL_LIGHTS %d\n", lightVariant);
+	}
+	const char *fragmentShader = kind == shadeFragments ? "fshader.glsl" : "depthfshader.glsl";
+	GLuint program = InitShader("vshader.glsl", fragmentShader, defines, sceneAttribNames);
+	shaderSeconds += clockSeconds() - start;
+	return program;
+}
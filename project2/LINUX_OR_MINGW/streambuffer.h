@@ -0,0 +1,134 @@
+// A ring buffer for data the CPU writes every frame (streambuffer.h)
+
+// The buffer is split into streamRegions regions, one per frame in flight.  Each frame
+// writes into the next region, after waiting on the fence placed when that region was
+// last used, so the CPU never overwrites data the GPU may still be reading.
+//
+// With OpenGL 4.4 (or ARB_buffer_storage) the buffer is mapped once, persistently and
+// coherently, so writing data is just a memcpy.  Otherwise each frame's region is
+// mapped unsynchronized (the fence already guarantees it's free) and unmapped before
+// drawing - so all of a frame's writes must come before its draws.
+
+const int streamRegions = 3;
+
+typedef struct {
+	GLenum target;
+	GLuint buffer;
+	GLsizeiptr regionSize;
+	GLsizeiptr tailSize;  // Spare space after the last region, so fixed-size ranges can be bound.
+	GLsync fences[streamRegions];
+	int region;  // The region being written this frame.
+	GLsizeiptr used;  // Bytes allocated so far in this region.
+	char *base;  // Mapped address of this region.
+	char *persistentMap;  // Mapped address of the whole buffer, if mapped persistently.
+	bool persistent;
+} StreamBuffer;
+
+static void streamCreateStorage(StreamBuffer *sb) {
+	GLsizeiptr total = sb->regionSize * streamRegions + sb->tailSize;
+
+	glGenBuffers(1, &sb->buffer); CheckError();
+	glBindBuffer(sb->target, sb->buffer); CheckError();
+	if (sb->persistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(sb->target, total, NULL, flags); CheckError();
+		sb->persistentMap = (char*) glMapBufferRange(sb->target, 0, total, flags); CheckError();
+	} else {
+		glBufferData(sb->target, total, NULL, GL_STREAM_DRAW); CheckError();
+		sb->persistentMap = NULL;
+	}
+
+	for (int r = 0; r < streamRegions; r++) {
+		sb->fences[r] = 0;
+	}
+	sb->region = 0;
+}
+
+void streamInit(StreamBuffer *sb, GLenum target, GLsizeiptr regionSize, GLsizeiptr tailSize) {
+	sb->target = target;
+	sb->regionSize = regionSize;
+	sb->tailSize = tailSize;
+	sb->persistent = glBufferStorage != NULL
+			&& (HasGLVersion(4, 4) || HasGLExtension("GL_ARB_buffer_storage"));
+	streamCreateStorage(sb);
+
+	printf("Streaming %s buffer: %d KB per frame, %s\n", target == GL_UNIFORM_BUFFER ? "uniform" : "data",
+			(int) (regionSize / 1024), sb->persistent ? "persistently mapped" : "mapped each frame");
+}
+
+// Replace the buffer with one whose regions are at least minRegionSize bytes.
+static void streamGrow(StreamBuffer *sb, GLsizeiptr minRegionSize) {
+	for (int r = 0; r < streamRegions; r++) {
+		if (sb->fences[r] != 0) glDeleteSync(sb->fences[r]);
+	}
+	glBindBuffer(sb->target, sb->buffer); CheckError();
+	if (sb->persistent) {
+		glUnmapBuffer(sb->target); CheckError();
+	}
+	glDeleteBuffers(1, &sb->buffer); CheckError();  // The GPU keeps it until it's finished with it
+
+	while (sb->regionSize < minRegionSize) {
+		sb->regionSize *= 2;
+	}
+	streamCreateStorage(sb);
+}
+
+// Start writing a frame's data, which must fit in bytesNeeded (including alignment).
+void streamBegin(StreamBuffer *sb, GLsizeiptr bytesNeeded) {
+	if (bytesNeeded > sb->regionSize) {
+		streamGrow(sb, bytesNeeded);
+	}
+
+	sb->region = (sb->region + 1) % streamRegions;
+	GLsync fence = sb->fences[sb->region];
+	if (fence != 0) {
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+			frameStats.fenceWaits++;  // The GPU is more than streamRegions - 1 frames behind
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); CheckError();
+		}
+		glDeleteSync(fence); CheckError();
+		sb->fences[sb->region] = 0;
+	}
+
+	GLintptr regionStart = sb->regionSize * sb->region;
+	if (sb->persistent) {
+		sb->base = sb->persistentMap + regionStart;
+	} else {
+		glBindBuffer(sb->target, sb->buffer); CheckError();
+		sb->base = (char*) glMapBufferRange(sb->target, regionStart, sb->regionSize,
+				GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT); CheckError();
+	}
+	sb->used = 0;
+}
+
+// Allocate size bytes at a multiple of align, returning the offset in the buffer (for
+// glBindBufferRange) and setting *ptr to where the data should be written.
+GLintptr streamAlloc(StreamBuffer *sb, GLsizeiptr size, GLsizeiptr align, void **ptr) {
+	GLsizeiptr offset = (sb->used + align - 1) / align * align;
+	if (offset + size > sb->regionSize) {
+		failInt("Error - streaming buffer region overflow, bytes:", (int) (offset + size));
+	}
+	sb->used = offset + size;
+	*ptr = sb->base + offset;
+	return sb->regionSize * sb->region + offset;
+}
+
+// Finish writing the frame's data (before any draws that read it).
+void streamEndWrites(StreamBuffer *sb) {
+	if (!sb->persistent) {
+		glBindBuffer(sb->target, sb->buffer); CheckError();
+		glUnmapBuffer(sb->target); CheckError();
+	}
+	sb->base = NULL;
+}
+
+// Bind part of the buffer to an indexed binding point (e.g. a uniform block binding).
+void streamBindRange(StreamBuffer *sb, GLuint binding, GLintptr offset, GLsizeiptr size) {
+	glBindBufferRange(sb->target, binding, sb->buffer, offset, size); CheckError();
+	frameStats.bufferRangeBinds++;
+}
+
+// Call after the frame's last draw that reads the buffer.
+void streamEndFrame(StreamBuffer *sb) {
+	sb->fences[sb->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); CheckError();
+}
@@ -0,0 +1,74 @@
+// Typed handles for shader uniforms (uniforms.h)
+
+// A handle holds a uniform's location, taken from the reflection data that InitShader
+// records when a program is linked, plus a shadow copy of the value last sent.  Setting
+// a uniform to the value it already has is skipped without making any GL call.
+// A handle belongs to one program, which must be in use (glUseProgram) when it is set.
+
+// The location of a uniform in a program, or -1 if the program doesn't use it.
+GLint uniformLocation(GLuint program, const char *name) {
+	const ShaderVariable *u = FindUniform(program, name);
+	if (u == NULL) {
+		fprintf(stderr, "Warning: uniform %s is not used by the shader program\n", name);
+		return -1;
+	}
+	return u->location;
+}
+
+// The location of a vertex attribute in a program, or -1 if the program doesn't use it.
+GLuint attribLocation(GLuint program, const char *name) {
+	const ShaderVariable *a = FindAttribute(program, name);
+	if (a == NULL) {
+		fprintf(stderr, "Warning: attribute %s is not used by the shader program\n", name);
+		return (GLuint) -1;
+	}
+	return a->location;
+}
+
+// Shared part of each handle: whether to skip an upload, and counting the result.
+static bool uniformUnchanged(GLint loc, bool known, const void *value, const void *newValue, size_t size) {
+	if (loc < 0) return true;
+	if (known && memcmp(value, newValue, size) == 0) {
+		frameStats.uniformSkips++;
+		return true;
+	}
+	frameStats.uniformCalls++;
+	return false;
+}
+
+struct UniformInt {
+	GLint loc;
+	bool known;  // Whether value is what the program currently holds.
+	GLint value;
+
+	void init(GLuint program, const char *name) {
+		loc = uniformLocation(program, name);
+		known = false;
+	}
+
+	void set(GLint v) {
+		if (uniformUnchanged(loc, known, &value, &v, sizeof(v))) return;
+		glUniform1i(loc, v); CheckError();
+		value = v;
+		known = true;
+	}
+};
+
+// Angel's mat4 is row-major, so matrices are sent transposed.
+struct UniformMat4 {
+	GLint loc;
+	bool known;
+	mat4 value;
+
+	void init(GLuint program, const char *name) {
+		loc = uniformLocation(program, name);
+		known = false;
+	}
+
+	void set(const mat4 &m) {
+		if (uniformUnchanged(loc, known, &value, &m, sizeof(m))) return;
+		glUniformMatrix4fv(loc, 1, GL_TRUE, m); CheckError();
+		value = m;
+		known = true;
+	}
+};
@@ -1,43 +1,100 @@
 #version 150
 
+#define MAX_INSTANCES 128  // Must match maxInstancesPerDraw in instancing.h
+
+// The most bones a vertex is blended from: 0, 1, 2 or 4 (set by shadervariants.h)
+#ifndef BONE_INFLUENCES
+#define BONE_INFLUENCES 4
+#endif
+
 in vec4 vPosition;
 in vec3 vNormal;
 in vec2 vTexCoord;
+#if BONE_INFLUENCES > 0
 in ivec4 boneIDs;
 in vec4 boneWeights;
+#endif
+in uint vInstance;  // The base instance plus gl_InstanceID (see mesharena.h)
+
+// The depth pre-pass uses this shader too, and its depths must match exactly (see depthprepass.h)
+invariant gl_Position;
 
-out vec3 fL1, fL2;
-out vec3 fE;
+out vec3 fPos;  // In eye coordinates
 out vec3 fN;
 out vec2 texCoord;
 
-uniform mat4 ModelView;
-uniform mat4 Projection;
-uniform vec4 LightPosition1, LightPosition2;
-uniform mat4 boneTransforms[64];
+// The material is the same across a whole instance
+flat out vec3 AmbientProduct, DiffuseProduct, SpecularProduct;
+flat out float Shininess;
+flat out float texScale;
 
-void main() {
-	mat4 boneTransform = boneWeights[0] * boneTransforms[boneIDs[0]];
-	boneTransform += boneWeights[1] * boneTransforms[boneIDs[1]];
-	boneTransform += boneWeights[2] * boneTransforms[boneIDs[2]];
-	boneTransform += boneWeights[3] * boneTransforms[boneIDs[3]];
+// Data for the whole frame (FrameData in instancing.h)
+layout(std140) uniform FrameBlock {
+	mat4 Projection;
+	mat4 View;
+	vec4 ClusterScale;  // The light cluster grid (see fshader.glsl)
+	ivec4 ClusterGrid;
+};
 
-	vec4 position = boneTransform * vPosition;
-	vec3 normal = mat3(boneTransform) * vNormal;
+struct ObjectData {
+	mat4 ModelView;
+	vec4 ambient;  // Ambient product, and texture scale in w
+	vec4 diffuse;  // Diffuse product, and the first matrix of the bone palette in w
+	vec4 specular;  // Specular product, and shininess in w
+};
 
-	// Transform vertex position into eye coordinates
-	vec3 pos = (ModelView * position).xyz;
+// Data for each instance in this draw (ObjectData in instancing.h)
+layout(std140) uniform ObjectBlock {
+	ObjectData objects[MAX_INSTANCES];
+};
 
-	// The vector to the light from the vertex
-	fL1 = LightPosition1.xyz - pos;
-	fL2 = LightPosition2.xyz - pos;
+#if BONE_INFLUENCES > 0
+// Every bone matrix posed this frame, each as four texels: its columns (see bonepalette.h)
+uniform samplerBuffer bonePalette;
 
-	// The vector to the eye/camera from the vertex
-	fE = -pos;
+mat4 boneTransform(int palette, int bone) {
+	int texel = (palette + bone) * 4;
+	return mat4(texelFetch(bonePalette, texel), texelFetch(bonePalette, texel + 1),
+			texelFetch(bonePalette, texel + 2), texelFetch(bonePalette, texel + 3));
+}
+#endif
+
+void main() {
+	ObjectData object = objects[vInstance];
+	mat4 ModelView = object.ModelView;
+
+#if BONE_INFLUENCES > 0
+	// The weights are sorted largest first, so the ones left out are 0
+	int palette = int(object.diffuse.w);
+	mat4 blend = boneWeights[0] * boneTransform(palette, boneIDs[0]);
+#if BONE_INFLUENCES > 1
+	blend += boneWeights[1] * boneTransform(palette, boneIDs[1]);
+#endif
+#if BONE_INFLUENCES > 2
+	blend += boneWeights[2] * boneTransform(palette, boneIDs[2]);
+	blend += boneWeights[3] * boneTransform(palette, boneIDs[3]);
+#endif
+
+	vec4 position = blend * vPosition;
+	vec3 normal = mat3(blend) * vNormal;
+#else
+	vec4 position = vPosition;
+	vec3 normal = vNormal;
+#endif
+
+	// Transform vertex position into eye coordinates (the fragment shader finds the
+	// vectors to the lights and the eye/camera from it)
+	fPos = (ModelView * position).xyz;
 
 	// Transform vertex normal into eye coordinates (assumes scaling is uniform across dimensions)
 	fN = (ModelView * vec4(normal, 0.0)).xyz;
 
 	gl_Position = Projection * ModelView * position;
 	texCoord = vTexCoord;
+
+	AmbientProduct = object.ambient.xyz;
+	DiffuseProduct = object.diffuse.xyz;
+	SpecularProduct = object.specular.xyz;
+	Shininess = object.specular.w;
+	texScale = object.ambient.w;
 }